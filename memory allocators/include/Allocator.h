@@ -1,45 +1,184 @@
 #pragma once
 
-#include <new.h>
+#include <new>
 #include <assert.h>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "VirtualMemory.h"
+
+class Allocator;
+
+namespace alloc
+{
+	// How an allocator expects its allocations to be freed.
+	enum class Frees : uint8_t
+	{
+		// Deallocate(address), the size is kept in a header in front of every allocation.
+		Unsized,
+		// Deallocate(address, size, alignment) with the values used to allocate, no header needed.
+		Sized
+	};
+
+	// Result of AllocateAtLeast(), like P0401 allocation_result.
+	struct Allocation
+	{
+		void *pointer;
+		// Bytes usable from pointer, at least the size requested.
+		size_t size;
+	};
+
+	// Kinds of memory an Allocator can sit on.
+	enum class Backing : uint8_t
+	{
+		// malloc the whole size upfront.
+		Heap,
+		// Only reserve address space, pages are committed as the allocator grows.
+		Virtual,
+		// Whole size mapped straight from the OS, bypassing the heap.
+		Mapped,
+		// Memory owned by the caller, e.g. a stack array, a static buffer or shared memory.
+		Buffer,
+		// Sub-block carved from a parent Allocator, given back when the allocator is destroyed.
+		Parent,
+		// Like Mapped, but on huge pages when available, see alloc::vm::MapHuge().
+		// GetPageMode() tells which kind of pages were actually used.
+		Huge
+	};
+
+	// Where an Allocator gets its memory from.
+	// Converts from Backing, so plain kinds can be passed directly.
+	struct Source
+	{
+		Source(Backing backing = Backing::Heap) :
+			backing(backing),
+			buffer(nullptr),
+			parent(nullptr),
+			alignment(16),
+			numa(vm::Numa::Default),
+			node(0)
+		{
+		}
+
+		// (@param buffer) must hold the size of the allocator, it isn't freed.
+		static Source FromBuffer(void *buffer)
+		{
+			Source source(Backing::Buffer);
+			source.buffer = buffer;
+			return source;
+		}
+
+		// Allocates the memory from (@param parent), which must outlive the allocator.
+		static Source FromParent(Allocator &parent, size_t alignment = 16)
+		{
+			Source source(Backing::Parent);
+			source.parent = &parent;
+			source.alignment = alignment;
+			return source;
+		}
+
+		// NUMA placement, honoured by the Virtual, Mapped and Huge backings.
+		// With FirstTouch the thread that will use the memory should call Allocator::Prefault().
+		static Source Placed(Backing backing, vm::Numa numa, unsigned node = 0)
+		{
+			Source source(backing);
+			source.numa = numa;
+			source.node = node;
+			return source;
+		}
+
+		Backing backing;
+		void *buffer;
+		Allocator *parent;
+		// Alignment of the block taken from the parent.
+		size_t alignment;
+		vm::Numa numa;
+		// Node for vm::Numa::Bind.
+		unsigned node;
+	};
+}
 
 // Interface for custom allocators.
-// Allocator frees memory on delete.
+// Allocator frees memory on delete, unless it came from a caller-provided buffer.
 class Allocator
 {
 public:
-	Allocator(size_t size) :
-		m_Size(size),
-		m_Start(malloc(size))
+	Allocator(size_t size, alloc::Source const &source = alloc::Source());
+	virtual ~Allocator();
+protected:
+	// For wrappers that forward to another allocator and own no memory.
+	Allocator() :
+		m_Size(0),
+		m_Start(nullptr),
+		m_UsedMemory(0),
+		m_Allocations(0),
+		m_Backing(alloc::Backing::Buffer),
+		m_Parent(nullptr),
+		m_ParentAlignment(0),
+		m_PageMode(alloc::vm::PageMode::Small),
+		m_Committed(nullptr)
 	{
-		m_UsedMemory = 0;
-		m_Allocations = 0;
 	}
 
-	virtual ~Allocator()
-	{
-		free(m_Start);
-
-		m_Start = nullptr;
-		m_Size = 0;
-	}
-protected:
 	size_t m_Size;
 	void *m_Start;
 	size_t m_UsedMemory;
 	size_t m_Allocations;
+	alloc::Backing m_Backing;
+	Allocator *m_Parent;
+	// The block is given back sized, the parent may not know its size.
+	size_t m_ParentAlignment;
+	alloc::vm::PageMode m_PageMode;
+	// End of the memory that can be written to.
+	void *m_Committed;
+
+	// Commit pages so that memory up to (@param end) can be written to.
+	// Only needed when end > m_Committed, returns false if the OS is out of memory.
+	bool CommitTo(void *end);
+
+	// Give the pages from (@param start) up to m_Committed back to the OS.
+	// Keeps the page (@param start) lies in, and does nothing if less than the commit granularity would be freed.
+	void DecommitFrom(void *start);
 public:
-	virtual void* Allocate(size_t size, uint8_t alignment = 4) = 0;
+	virtual void* Allocate(size_t size, size_t alignment = 4) = 0;
 	virtual void Deallocate(void *address) = 0;
+	// Sized deallocation, like C++14 sized delete, for callers that know what they allocated.
+	// Required by allocators in alloc::Frees::Sized mode, the rest ignore the extra arguments.
+	virtual void Deallocate(void *address, size_t size_not_used, size_t alignment_not_used) { Deallocate(address); }
+	// Like Allocate(), but also returns how many bytes the allocation really has,
+	// e.g. when an allocator hands out a whole block rather than splitting off a sliver.
+	// Any size between the requested and the returned one can be passed to a sized Deallocate.
+	virtual alloc::Allocation AllocateAtLeast(size_t size, size_t alignment = 4)
+	{
+		void *const address = Allocate(size, alignment);
+		return{ address, address ? size : 0 };
+	}
+	// Resize an allocation, like realloc. (@param old_size) and (@param alignment) must be the ones it was made with.
+	// Returns nullptr and leaves the allocation untouched if there's no room.
+	// By default allocates, copies and frees, allocators override it to resize in place where they can.
+	virtual void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment);
+	// Whether (@param address) lies in this allocator's memory, a single range check.
+	virtual bool Owns(void *address) const
+	{
+		return reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(m_Start) < m_Size;
+	}
 
 	void* GetStart() const { return m_Start; }
 	size_t GetSize() const { return m_Size; }
-	size_t GetUsedMemory() const { return m_UsedMemory; }
-	size_t GetNumAllocations() const { return m_Allocations; }
+	// Virtual for allocators that keep their statistics elsewhere than m_UsedMemory and m_Allocations.
+	virtual size_t GetUsedMemory() const { return m_UsedMemory; }
+	virtual size_t GetNumAllocations() const { return m_Allocations; }
+	alloc::Backing GetBacking() const { return m_Backing; }
+	alloc::vm::PageMode GetPageMode() const { return m_PageMode; }
+
+	// Touch every committed page from the calling thread, placing it on its node under first-touch.
+	void Prefault() { alloc::vm::Prefault(m_Start, GetCommittedMemory()); }
+	size_t GetCommittedMemory() const { return reinterpret_cast<uintptr_t>(m_Committed) - reinterpret_cast<uintptr_t>(m_Start); }
 };
 
 namespace alloc { namespace math
@@ -59,81 +198,213 @@ namespace alloc { namespace math
 	// Align memory address by (@param alignment) amount of bytes.
 	// This masks the (@param alignment - 1) bit and adds to address.
 	// @param alignment must be power of 2.
-	inline void* Align(void *address, uint8_t alignment)
+	inline void* Align(void *address, size_t alignment)
 	{
-		return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(address) + static_cast<uintptr_t>(alignment - 1) & static_cast<uintptr_t>(~(alignment - 1)));
+		return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(address) + (alignment - 1)) & ~static_cast<uintptr_t>(alignment - 1));
 	}
 	
 	// NOTE: not suited for checking alignment, as it doesn't work as expected with addresses.
 	// How many bytes needed to adjust address for alignment.
 	// @param alignment must be power of 2.
-	inline uint8_t AdjustmentFromAlign(void *address, uint8_t alignment)
+	inline size_t AdjustmentFromAlign(void *address, size_t alignment)
 	{
-		const uint8_t adjustment = alignment - (reinterpret_cast<uintptr_t>(address) & static_cast<uintptr_t>(alignment - 1));
-
-		// If already aligned, return 0.
-		return (adjustment == alignment) ? 0 : adjustment;
+		// Distance to the next multiple of alignment, 0 if already aligned.
+		return (0 - reinterpret_cast<uintptr_t>(address)) & static_cast<uintptr_t>(alignment - 1);
 	}
 
 	// How many bytes are needed to adjust for alignment with a header.
 	// @param alignment must be power of 2.
-	inline uint8_t AdjustmentFromAlignWithHeader(void *address, uint8_t alignment, uint8_t header_size)
+	inline size_t AdjustmentFromAlignWithHeader(void *address, size_t alignment, size_t header_size)
 	{
-		uint8_t adjustment = AdjustmentFromAlign(address, alignment);
+		// Align the address past the header, so the adjustment always fits it.
+		return header_size + AdjustmentFromAlign(Add(address, header_size), alignment);
+	}
+
+	// Headers keep the adjustment in a byte. Adjustments that don't fit, only possible with
+	// alignments over kInlineAlignment, are marked kSpilledAdjustment and stored in the padding in front of the header.
+	const size_t kInlineAlignment = 64;
+	const uint8_t kSpilledAdjustment = 0xFF;
 
-		if (adjustment < header_size)
+	// Store (@param adjustment) in (@param header), which must sit right before the aligned address.
+	template<class H>
+	inline void StoreAdjustment(H *header, size_t adjustment)
+	{
+		static_assert(kInlineAlignment + sizeof(H) < kSpilledAdjustment, "Header too big to keep small adjustments inline");
+
+		if (adjustment < kSpilledAdjustment)
 		{
-			uint8_t needed_header_space = header_size - adjustment;
+			header->adjustment = static_cast<uint8_t>(adjustment);
+			return;
+		}
 
-			// Make it so the adjustment fits the header.
-			adjustment += alignment*(needed_header_space/alignment);
+		// The padding is at least kSpilledAdjustment - sizeof(H) bytes, plenty for a size_t.
+		header->adjustment = kSpilledAdjustment;
+		memcpy(Subtract(header, sizeof(size_t)), &adjustment, sizeof(size_t));
+	}
 
-			// If needed space for header is not aligned, increase adjustment safely.
-			if (needed_header_space % alignment > 0)
-			{
-				adjustment += alignment;
-			}
+	// Read the adjustment written by StoreAdjustment().
+	template<class H>
+	inline size_t LoadAdjustment(H const *header)
+	{
+		if (header->adjustment != kSpilledAdjustment)
+		{
+			return header->adjustment;
 		}
 
+		size_t adjustment;
+		memcpy(&adjustment, Subtract(const_cast<H*>(header), sizeof(size_t)), sizeof(size_t));
 		return adjustment;
 	}
 }}
 
 namespace alloc
 {
-	template<class T>
-	void* Allocate(Allocator *allocator)
+	// Allocator concept: A has Allocate(size, alignment) returning void*, and Deallocate(address).
+	// Both Allocator and the concrete allocators satisfy it.
+	// Through a concrete type the calls bind statically, since the concrete overrides are final.
+	template<class A, class = void>
+	struct IsAllocator : std::false_type {};
+
+	template<class A>
+	struct IsAllocator<A, decltype(
+		static_cast<void*>(std::declval<A&>().Allocate(size_t(), size_t())),
+		std::declval<A&>().Deallocate(static_cast<void*>(nullptr)))> : std::true_type {};
+
+	namespace detail
 	{
-		return allocator->Allocate(sizeof T, alignof(T));
+		template<class A>
+		auto DeallocateSized(A &allocator, void *address, size_t size, size_t alignment, int) -> decltype(allocator.Deallocate(address, size, alignment))
+		{
+			return allocator.Deallocate(address, size, alignment);
+		}
+
+		template<class A>
+		void DeallocateSized(A &allocator, void *address, size_t size_not_used, size_t alignment_not_used, long)
+		{
+			allocator.Deallocate(address);
+		}
 	}
 
-	template<class T>
-	T* Allocate(Allocator *allocator, T *t)
+	// Sized deallocation when A has it, plain deallocation otherwise.
+	template<class A>
+	void DeallocateSized(A &allocator, void *address, size_t size, size_t alignment)
 	{
-		return new(allocator->Allocate(sizeof T, alignof(T))) T(t);
+		detail::DeallocateSized(allocator, address, size, alignment, 0);
 	}
 
-	template<class T>
-	void Deallocate(Allocator *allocator, T *object)
+	namespace detail
+	{
+		template<class A>
+		auto AllocateAtLeast(A &allocator, size_t size, size_t alignment, int) -> decltype(allocator.AllocateAtLeast(size, alignment))
+		{
+			return allocator.AllocateAtLeast(size, alignment);
+		}
+
+		template<class A>
+		Allocation AllocateAtLeast(A &allocator, size_t size, size_t alignment, long)
+		{
+			void *const address = allocator.Allocate(size, alignment);
+			return{ address, address ? size : 0 };
+		}
+	}
+
+	namespace detail
+	{
+		template<class A>
+		auto Reallocate(A &allocator, void *address, size_t old_size, size_t new_size, size_t alignment, int) -> decltype(allocator.Reallocate(address, old_size, new_size, alignment))
+		{
+			return allocator.Reallocate(address, old_size, new_size, alignment);
+		}
+
+		template<class A>
+		void* Reallocate(A &allocator, void *address, size_t old_size, size_t new_size, size_t alignment, long)
+		{
+			void *const new_address = allocator.Allocate(new_size, alignment);
+
+			if (new_address && address)
+			{
+				memcpy(new_address, address, old_size < new_size ? old_size : new_size);
+				alloc::DeallocateSized(allocator, address, old_size, alignment);
+			}
+
+			return new_address;
+		}
+	}
+
+	// Reallocate() when A has it, allocate, copy and free otherwise.
+	template<class A>
+	void* Reallocate(A &allocator, void *address, size_t old_size, size_t new_size, size_t alignment)
+	{
+		return detail::Reallocate(allocator, address, old_size, new_size, alignment, 0);
+	}
+
+	namespace detail
+	{
+		template<class A>
+		auto Owns(A const &allocator, void *address, int) -> decltype(allocator.Owns(address))
+		{
+			return allocator.Owns(address);
+		}
+
+		template<class A>
+		bool Owns(A const &allocator_not_used, void *address_not_used, long)
+		{
+			return false;
+		}
+	}
+
+	// Owns() when A has it. Allocators without it can't tell, so they own nothing as far as composition goes.
+	template<class A>
+	bool Owns(A const &allocator, void *address)
+	{
+		return detail::Owns(allocator, address, 0);
+	}
+
+	// AllocateAtLeast() when A has it, exactly (@param size) bytes otherwise.
+	template<class A>
+	Allocation AllocateAtLeast(A &allocator, size_t size, size_t alignment)
+	{
+		return detail::AllocateAtLeast(allocator, size, alignment, 0);
+	}
+
+	// The helpers below take either an Allocator* or a pointer to a concrete allocator.
+	// Prefer the concrete type in hot code, it avoids the virtual call and allows inlining.
+	template<class T, class A>
+	void* Allocate(A *allocator)
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		return allocator->Allocate(sizeof(T), alignof(T));
+	}
+
+	template<class T, class A>
+	T* Allocate(A *allocator, T *t)
+	{
+		return new(Allocate<T>(allocator)) T(t);
+	}
+
+	template<class T, class A>
+	void Deallocate(A *allocator, T *object)
 	{
 		object->~T();
-		allocator->Deallocate(object);
+		DeallocateSized(*allocator, object, sizeof(T), alignof(T));
 	}
 
-	template<class T>
-	T* AllocateArray(Allocator *allocator, size_t array_length)
+	template<class T, class A>
+	T* AllocateArray(A *allocator, size_t array_length)
 	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
 		assert(array_length != 0);
 
-		uint8_t header_size = sizeof size_t / sizeof T;
+		uint8_t header_size = sizeof(size_t) / sizeof(T);
 
-		if (sizeof size_t % sizeof T  > 0)
+		if (sizeof(size_t) % sizeof(T)  > 0)
 		{
 			++header_size;
 		}
 
 		// Note: allocates extra memory to store array length before the array.
-		T *array_pointer = static_cast<T*>(allocator->Allocate(sizeof T*(array_length + header_size), alignof(T))) + header_size;
+		T *array_pointer = static_cast<T*>(allocator->Allocate(sizeof(T)*(array_length + header_size), alignof(T))) + header_size;
 
 		// Header holds array length.
 		*(reinterpret_cast<uintptr_t*>(array_pointer) - 1) = array_length;
@@ -148,8 +419,8 @@ namespace alloc
 		return array_pointer;
 	}
 
-	template<class T>
-	void DeallocateArray(Allocator *allocator, T *array_object)
+	template<class T, class A>
+	void DeallocateArray(A *allocator, T *array_object)
 	{
 		assert(array_object != nullptr);
 
@@ -161,14 +432,14 @@ namespace alloc
 		}
 
 		// How much extra memory was allocated to store the length before the array.
-		uint8_t header_size = sizeof size_t / sizeof T;
+		uint8_t header_size = sizeof(size_t) / sizeof(T);
 
-		if (sizeof size_t % sizeof T > 0)
+		if (sizeof(size_t) % sizeof(T) > 0)
 		{
 			++header_size;
 		}
 
-		allocator->Deallocate(array_object - header_size);
+		DeallocateSized(*allocator, array_object - header_size, sizeof(T)*(length + header_size), alignof(T));
 	}
 
 	// Rarely used, since most object are naturally aligned.
@@ -185,56 +456,65 @@ namespace alloc
 		return !math::AdjustmentFromAlign(obj, alignment);
 	}
 
-	template<class T>
+	template<class T, class A = Allocator>
 	struct destroy
 	{
-		Allocator *alloc = nullptr;
+		A *alloc = nullptr;
+
+		destroy() = default;
+		destroy(A *allocator) : alloc(allocator) {}
+
+		// Allows unique_ptr<T, LinearAllocator> to convert to unique_ptr<T>.
+		template<class B>
+		destroy(destroy<T, B> const &other) : alloc(other.alloc) {}
 		
 		void operator()(T *t) const
 		{
 			assert(t);
 			t->~T();
 			assert(alloc);
-			alloc->Deallocate(t);
+			DeallocateSized(*alloc, t, sizeof(T), alignof(T));
 		}
 	};
 
 	// Alias template for our unique_ptr with our deleter type.
-	template<class T>
+	template<class T, class A = Allocator>
 	// Overshadows unique_ptr, and supports deallocation with custom allocators.
-	using unique_ptr = std::unique_ptr<T, destroy<T>>;
+	using unique_ptr = std::unique_ptr<T, destroy<T, A>>;
 
 	namespace factory
 	{
-		template<class T, class...Args>
-		unique_ptr<T> make_unique(Allocator *alloc, Args&&...args)
+		template<class T, class A, class...Args>
+		unique_ptr<T, A> make_unique(A *alloc, Args&&...args)
 		{
+			static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
 			void *p_data = alloc->Allocate(sizeof(T), alignof(T));
 
 			try
 			{
 				T *ret = ::new(p_data) T(std::forward<Args>(args)...);
-				return{ ret, destroy<T>{alloc} };
+				return{ ret, destroy<T, A>(alloc) };
 			}
 			catch (...)
 			{
-				alloc->Deallocate(p_data);
+				DeallocateSized(*alloc, p_data, sizeof(T), alignof(T));
 				throw;
 			}
 		}
 	}
 
-	template<class T, class...Args>
-	unique_ptr<T> make_unique(Allocator *alloc, Args&&...args)
+	template<class T, class A, class...Args>
+	unique_ptr<T, A> make_unique(A *alloc, Args&&...args)
 	{
 		return factory::make_unique<T>(alloc, std::forward<Args>(args)...);
 	}
 
 	// Overload for initializer_list.
-	template<class T, class U, class...Args>
-	unique_ptr<T> make_unique(Allocator *alloc, std::initializer_list<U> il, Args&&...args)
+	template<class T, class A, class U, class...Args>
+	unique_ptr<T, A> make_unique(A *alloc, std::initializer_list<U> il, Args&&...args)
 	{
-		return factory::make_unique<T>(alloc, il, std::forward<Args>(args));
+		return factory::make_unique<T>(alloc, il, std::forward<Args>(args)...);
 	}
 
 	// Overload for braces construction.
@@ -242,8 +522,8 @@ namespace alloc
 	template<class T> struct tag_t { using type = T; };
 	// Default Template Argument, for specifying which type is use.
 	template<class T> using no_deduction = typename tag_t<T>::type;
-	template<class T>
-	unique_ptr<T> make_unique(Allocator *alloc, no_deduction<T> &&t)
+	template<class T, class A>
+	unique_ptr<T, A> make_unique(A *alloc, no_deduction<T> &&t)
 	{
 		return factory::make_unique<T>(alloc, std::move(t));
 	}
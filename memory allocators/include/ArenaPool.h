@@ -0,0 +1,47 @@
+#pragma once
+
+#include "LinearAllocator.h"
+
+#include <mutex>
+#include <vector>
+
+// Recycles LinearAllocators for short lifetimes, such as an arena per request.
+// Arenas are sized into classes and kept on a free list per class, so reuse skips malloc, free and page faults.
+// Arenas that stay unused for more than max_idle_trims calls to Trim() are freed.
+class ArenaPool
+{
+	ArenaPool(ArenaPool const&);
+public:
+	ArenaPool(size_t max_idle_trims = 4, alloc::Backing backing = alloc::Backing::Heap);
+	~ArenaPool();
+
+	// Size of the smallest class, every next class is 4 times bigger.
+	static const size_t kMinArenaSize = 65536;
+	// Classes go up to 64MB, bigger arenas aren't pooled.
+	static const unsigned kNumClasses = 6;
+private:
+	struct IdleArena
+	{
+		LinearAllocator *arena;
+		// Value of m_Trims when the arena was released.
+		size_t released_at;
+	};
+
+	// Most recently released arena last, so reuse keeps hitting warm memory.
+	std::vector<IdleArena> m_FreeLists[kNumClasses];
+	size_t m_Trims;
+	size_t m_MaxIdleTrims;
+	alloc::Backing m_Backing;
+	mutable std::mutex m_Mutex;
+
+	static unsigned ClassFromSize(size_t size);
+public:
+	// Cleared arena of at least (@param size) bytes.
+	LinearAllocator* Acquire(size_t size);
+	// Give back an arena from Acquire(), whatever was allocated on it is freed.
+	void Release(LinearAllocator *arena);
+	// Free arenas that have been idle for too long, meant to be called periodically.
+	void Trim();
+
+	size_t GetNumIdleArenas() const;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <memory>
+
+namespace alloc
+{
+	// Size classes of Step bytes up to Max, one A per class, e.g. a PoolAllocator per object size.
+	// Bucket i serves sizes up to (i + 1) * Step and is made by factory((i + 1) * Step), which returns a new A.
+	// Bigger sizes return nullptr, put a Segregator in front to handle them.
+	// Unsized Deallocate searches the buckets with Owns(), sized Deallocate goes straight to the bucket.
+	template<class A, size_t Step, size_t Max>
+	class Bucketizer
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+		static_assert(Step > 0 && Max % Step == 0, "Max must be a multiple of Step");
+
+		Bucketizer(Bucketizer const&);
+	public:
+		static const size_t kNumBuckets = Max / Step;
+
+		template<class Factory>
+		Bucketizer(Factory factory)
+		{
+			for (size_t i = 0; i < kNumBuckets; i++)
+			{
+				m_Buckets[i].reset(factory((i + 1) * Step));
+				assert(m_Buckets[i]);
+			}
+		}
+	private:
+		std::unique_ptr<A> m_Buckets[kNumBuckets];
+
+		static size_t BucketIndex(size_t size) { return (size - 1) / Step; }
+	public:
+		// Pools only take their object size, so the request goes through AllocateAtLeast.
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			assert(size != 0);
+
+			if (size > Max)
+			{
+				return nullptr;
+			}
+
+			return AllocateAtLeast(*m_Buckets[BucketIndex(size)], size, alignment).pointer;
+		}
+
+		void Deallocate(void *address)
+		{
+			for (size_t i = 0; i < kNumBuckets; i++)
+			{
+				if (m_Buckets[i]->Owns(address))
+				{
+					m_Buckets[i]->Deallocate(address);
+					return;
+				}
+			}
+
+			assert(false && "Address doesn't belong to any bucket");
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			assert(size != 0 && size <= Max);
+
+			DeallocateSized(*m_Buckets[BucketIndex(size)], address, size, alignment);
+		}
+
+		bool Owns(void *address) const
+		{
+			for (size_t i = 0; i < kNumBuckets; i++)
+			{
+				if (m_Buckets[i]->Owns(address))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		A& GetBucket(size_t index) const
+		{
+			assert(index < kNumBuckets);
+
+			return *m_Buckets[index];
+		}
+	};
+}
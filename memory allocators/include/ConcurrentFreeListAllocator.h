@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <atomic>
+#include <mutex>
+
+// Free list allocator that many threads can share, with a lock per size class instead of one for the whole heap.
+// Free blocks sit in kNumBins bins, each with its own lock and list: one per block size below kSmallLimit,
+// so any block in the bin fits, then power of 2 size ranges searched first fit.
+// Allocate takes a block from the smallest bin that has one, skipping empty bins without locking them, and splits off the rest into its bin.
+// Deallocate puts the block back in its bin without touching the neighbours, so threads only meet on the same size class.
+//
+// Adjacent free blocks are merged by Consolidate(), when an allocation finds nothing or when called,
+// which takes every bin's lock in index order and rebuilds the bins from a walk over the heap.
+// Every block header is written under a bin lock, so the walk sees a consistent heap.
+//
+// The statistics are relaxed atomics, read by GetUsedMemory() and GetNumAllocations().
+class ConcurrentFreeListAllocator : public Allocator
+{
+	ConcurrentFreeListAllocator(ConcurrentFreeListAllocator const&);
+public:
+	ConcurrentFreeListAllocator(size_t size, alloc::Source const &source = alloc::Source());
+	~ConcurrentFreeListAllocator();
+private:
+	// In front of every block. Free blocks link to the next one in their bin, allocated ones start their memory there.
+	struct Block
+	{
+		Block *next;
+		// Block size, a multiple of kGranule, with the flags in the low bits.
+		size_t size_and_flags;
+	};
+
+	// Aligned to a cache line, taking one bin's lock doesn't invalidate the head that threads skipping past the next one read.
+	struct alignas(64) Bin
+	{
+		Bin() :
+			head(nullptr)
+		{
+		}
+
+		std::mutex lock;
+		// Only changed under the lock, read without it to skip empty bins.
+		std::atomic<Block*> head;
+	};
+
+	static const size_t kGranule = 2 * sizeof(void*);
+	static const size_t kMinBlockSize = sizeof(Block) + kGranule;
+	// Blocks below it have a bin of their own size, bin (size / kGranule).
+	static const size_t kSmallLimit = 64 * kGranule;
+	// Then bin 64 + i holds blocks of [kSmallLimit << i, kSmallLimit << (i + 1)), the last one everything bigger.
+	static const unsigned kNumBins = 64 + 24;
+
+	// Listed in a bin. Blocks taken out of a bin stay unflagged until they're listed again,
+	// so Consolidate() doesn't merge a block another thread is about to list.
+	static const size_t kFree = 1;
+	// Word in front of an over-aligned allocation, holding its offset from the block instead of the block size.
+	static const size_t kOffset = 2;
+	static const size_t kFlags = kGranule - 1;
+
+	Bin m_Bins[kNumBins];
+	Block *m_FirstBlock;
+	uintptr_t m_End;
+
+	std::atomic<size_t> m_Used;
+	std::atomic<size_t> m_Count;
+	std::atomic<size_t> m_Consolidations;
+
+	static unsigned BinFromSize(size_t size);
+	static size_t SizeOf(Block const *block) { return block->size_and_flags & ~kFlags; }
+
+	// Lists (@param block) of (@param size) in its bin.
+	void List(Block *block, size_t size);
+	// Takes a block of at least (@param size) from (@param bin), splitting off the rest, or nullptr.
+	Block* TakeFrom(unsigned bin, size_t size);
+	Block* BlockFromAddress(void *address) const;
+public:
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
+
+	// Merges adjacent free blocks, taking every bin's lock in index order. Returns the size of the largest free block.
+	size_t Consolidate();
+
+	size_t GetUsedMemory() const final;
+	size_t GetNumAllocations() const final;
+	size_t GetNumConsolidations() const;
+};
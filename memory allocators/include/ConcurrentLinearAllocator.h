@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <atomic>
+
+// Linear allocator that many threads can fill at the same time.
+// Allocate is a compare_exchange on the offset, retried only when another thread moved it first.
+// Small allocations should go through a Lease, which bumps a per-thread sub-block instead.
+//
+// Allocations aren't counted, as that would cost a second atomic per allocation.
+// Clear() and the destructor must not run while other threads allocate.
+class ConcurrentLinearAllocator : public Allocator
+{
+	ConcurrentLinearAllocator(ConcurrentLinearAllocator const&);
+public:
+	ConcurrentLinearAllocator(size_t size, alloc::Source const &source = alloc::Source());
+	~ConcurrentLinearAllocator();
+private:
+	// Offset of the first free byte from m_Start, never past m_Size.
+	std::atomic<size_t> m_Offset;
+public:
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address_not_used) final;
+	void Deallocate(void *address_not_used, size_t size_not_used, size_t alignment_not_used) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
+	void Clear();
+
+	// The offset, m_UsedMemory isn't updated concurrently.
+	size_t GetUsedMemory() const final;
+
+	// Sub-block of the arena owned by a single thread.
+	// Allocations that fit are plain pointer bumps, the shared offset is only touched to lease a new block.
+	class Lease
+	{
+		Lease(Lease const&);
+	public:
+		Lease(ConcurrentLinearAllocator &arena, size_t block_size = 65536);
+		~Lease();
+	private:
+		ConcurrentLinearAllocator &m_Arena;
+		size_t m_BlockSize;
+		void *m_CurrentPosition;
+		void *m_End;
+	public:
+		void* Allocate(size_t size, size_t alignment);
+	};
+};
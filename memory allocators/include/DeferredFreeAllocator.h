@@ -0,0 +1,270 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace alloc
+{
+	// Takes Deallocate off the caller's thread: freed blocks are pushed onto a lock-free list threaded through them,
+	// and a background thread takes the whole list kIntervalMs after the first one arrives, or once kBatchSize blocks are waiting,
+	// sorts it by address and frees it under Lock, in one go. Freeing in address order walks the allocator's memory forward,
+	// for a FreeListAllocator neighbouring blocks coalesce one after another. With nothing queued the thread sleeps until the next free.
+	// Allocations take the same lock, so they may wait for a batch. One that fails frees what's queued itself and tries again.
+	//
+	// Freed blocks hold the list link, so allocations are rounded up to a pointer. Deferred frees are unsized.
+	// A must outlive it. Queued blocks count as allocated in A until the background thread frees them, Flush() before reading it.
+	template<class A, class Lock = std::mutex>
+	class DeferredFreeAllocator
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		DeferredFreeAllocator(DeferredFreeAllocator const&);
+
+		struct Node
+		{
+			Node *next;
+		};
+	public:
+		DeferredFreeAllocator(A &alloc) :
+			m_Allocator(alloc),
+			m_Pending(nullptr),
+			m_NumPending(0),
+			m_FlushRequested(0),
+			m_FlushDone(0),
+			m_Stop(false),
+			m_NumFreed(0),
+			m_NumBatches(0)
+		{
+			m_Thread = std::thread(&DeferredFreeAllocator::Run, this);
+		}
+
+		// Frees whatever is still queued and stops the thread, no thread may free concurrently by now.
+		~DeferredFreeAllocator()
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_QueueMutex);
+				m_Stop = true;
+			}
+
+			m_Wake.notify_one();
+			m_Thread.join();
+		}
+	private:
+		static const unsigned kBatchSize = 1024;
+		static const unsigned kIntervalMs = 1;
+
+		A &m_Allocator;
+		Lock m_Lock;
+		std::thread m_Thread;
+
+		// Written by every freeing thread, kept off the other fields' cache lines.
+		alignas(64) std::atomic<Node*> m_Pending;
+		std::atomic<unsigned> m_NumPending;
+
+		alignas(64) std::mutex m_QueueMutex;
+		std::condition_variable m_Wake;
+		std::condition_variable m_Flushed;
+		unsigned long long m_FlushRequested;
+		unsigned long long m_FlushDone;
+		bool m_Stop;
+
+		// Background thread only.
+		std::vector<void*> m_Batch;
+		// Under Lock, read after Flush().
+		size_t m_NumFreed;
+		size_t m_NumBatches;
+
+		static size_t LinkSize(size_t size)
+		{
+			return size < sizeof(Node) ? sizeof(Node) : size;
+		}
+
+		void Run()
+		{
+			std::unique_lock<std::mutex> queue(m_QueueMutex);
+
+			const auto ready = [this]()
+			{
+				return m_Stop || m_FlushRequested != m_FlushDone || m_NumPending.load(std::memory_order_relaxed) >= kBatchSize;
+			};
+
+			for (;;)
+			{
+				// Nothing to free, no reason to wake up until a free arrives.
+				m_Wake.wait(queue, [this, &ready]() { return ready() || m_Pending.load(std::memory_order_relaxed); });
+				// Then give the batch a little time to fill up.
+				m_Wake.wait_for(queue, std::chrono::milliseconds(kIntervalMs), ready);
+
+				// Everything pushed before the requests read here is taken below.
+				const unsigned long long flush_requested = m_FlushRequested;
+				const bool stop = m_Stop;
+
+				queue.unlock();
+				FreePending();
+				queue.lock();
+
+				m_FlushDone = flush_requested;
+				m_Flushed.notify_all();
+
+				if (stop)
+				{
+					return;
+				}
+			}
+		}
+
+		void FreePending()
+		{
+			Node *node = m_Pending.exchange(nullptr, std::memory_order_acquire);
+
+			if (!node)
+			{
+				return;
+			}
+
+			m_Batch.clear();
+
+			for (; node; node = node->next)
+			{
+				m_Batch.push_back(node);
+			}
+
+			m_NumPending.fetch_sub(static_cast<unsigned>(m_Batch.size()), std::memory_order_relaxed);
+
+			std::sort(m_Batch.begin(), m_Batch.end());
+
+			std::lock_guard<Lock> guard(m_Lock);
+
+			for (void *address : m_Batch)
+			{
+				m_Allocator.Deallocate(address);
+			}
+
+			m_NumFreed += m_Batch.size();
+			m_NumBatches++;
+		}
+
+		// Under Lock, frees the queued blocks right away, unsorted, for an allocation that found no room.
+		// Returns false if nothing was queued. A batch the background thread took already is freed by it.
+		bool FreePendingNow()
+		{
+			Node *node = m_Pending.exchange(nullptr, std::memory_order_acquire);
+			size_t count = 0;
+
+			while (node)
+			{
+				Node *next = node->next;
+				m_Allocator.Deallocate(node);
+				node = next;
+				count++;
+			}
+
+			m_NumPending.fetch_sub(static_cast<unsigned>(count), std::memory_order_relaxed);
+			m_NumFreed += count;
+
+			return count != 0;
+		}
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			void *address = m_Allocator.Allocate(LinkSize(size), alignment);
+
+			if (!address && FreePendingNow())
+			{
+				address = m_Allocator.Allocate(LinkSize(size), alignment);
+			}
+
+			return address;
+		}
+
+		// Queued for the background thread, returns right away.
+		void Deallocate(void *address)
+		{
+			if (!address)
+			{
+				return;
+			}
+
+			Node *node = static_cast<Node*>(address);
+			Node *head = m_Pending.load(std::memory_order_relaxed);
+
+			// The node may be freed as soon as it's pushed, so the old head is kept aside instead of read back from it.
+			do
+			{
+				node->next = head;
+			} while (!m_Pending.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+
+			const unsigned pending = m_NumPending.fetch_add(1, std::memory_order_relaxed) + 1;
+
+			// Only the push onto an empty list and the one that fills a batch wake the thread.
+			// Taking the mutex makes sure the thread either saw the push or is waiting already.
+			if (!head || pending == kBatchSize)
+			{
+				{
+					std::lock_guard<std::mutex> queue(m_QueueMutex);
+				}
+
+				m_Wake.notify_one();
+			}
+		}
+
+		void Deallocate(void *address, size_t size_not_used, size_t alignment_not_used)
+		{
+			Deallocate(address);
+		}
+
+		Allocation AllocateAtLeast(size_t size, size_t alignment)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			Allocation allocation = alloc::AllocateAtLeast(m_Allocator, LinkSize(size), alignment);
+
+			if (!allocation.pointer && FreePendingNow())
+			{
+				allocation = alloc::AllocateAtLeast(m_Allocator, LinkSize(size), alignment);
+			}
+
+			return allocation;
+		}
+
+		void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			void *new_address = alloc::Reallocate(m_Allocator, address, LinkSize(old_size), LinkSize(new_size), alignment);
+
+			if (!new_address && FreePendingNow())
+			{
+				new_address = alloc::Reallocate(m_Allocator, address, LinkSize(old_size), LinkSize(new_size), alignment);
+			}
+
+			return new_address;
+		}
+
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		// Waits until everything deallocated before the call has been freed, e.g. before shutting down or reading the allocator.
+		void Flush()
+		{
+			std::unique_lock<std::mutex> queue(m_QueueMutex);
+			const unsigned long long request = ++m_FlushRequested;
+
+			m_Wake.notify_one();
+			m_Flushed.wait(queue, [this, request]() { return m_FlushDone >= request; });
+		}
+
+		// Read after Flush().
+		size_t GetNumFreed() const { return m_NumFreed; }
+		size_t GetNumBatches() const { return m_NumBatches; }
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
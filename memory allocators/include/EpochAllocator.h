@@ -0,0 +1,253 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace alloc
+{
+	// Epoch based reclamation over an allocator, usually a PoolAllocator of lock-free nodes.
+	// Every thread Join()s once and gets a Participant. It Enter()s before touching shared nodes and Exit()s after,
+	// unlinked nodes are Retire()d instead of freed. The epoch only moves once every thread inside has seen it,
+	// so each Participant keeps three limbo lists, one per epoch mod 3, and frees a list in a single batch under Lock
+	// when it enters an epoch that maps onto that list again, at least three epochs after its nodes were retired.
+	//
+	// Retiring appends to the thread's own list, so it costs no atomics, and freeing one pool free per node.
+	// Limbo lists are kept beside the nodes rather than threaded through them, other threads may still read a retired node.
+	// A must outlive it, retired nodes stay allocated in A until their epoch comes round.
+	template<class A, class Lock = std::mutex>
+	class EpochAllocator
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		EpochAllocator(EpochAllocator const&);
+
+		static const unsigned kNumEpochs = 3;
+		// Retires between attempts to move the epoch, each one reads every participant.
+		static const unsigned kAdvanceEvery = 64;
+	public:
+		class Participant
+		{
+			friend class EpochAllocator;
+
+			Participant(Participant const&);
+
+			Participant(EpochAllocator &epochs) :
+				m_Epochs(epochs),
+				m_State(0),
+				m_Epoch(0),
+				m_Retires(0),
+				m_NumRetired(0),
+				m_NumReclaimed(0),
+				m_Next(nullptr)
+			{
+			}
+
+			EpochAllocator &m_Epochs;
+			// Epoch << 1 | 1 while inside, read by the other threads.
+			alignas(64) std::atomic<unsigned> m_State;
+			// The rest is only touched by the owning thread.
+			alignas(64) unsigned m_Epoch;
+			unsigned m_Retires;
+			size_t m_NumRetired;
+			size_t m_NumReclaimed;
+			std::vector<void*> m_Limbo[kNumEpochs];
+			// Next in the participant list, set before it's published and never changed.
+			Participant *m_Next;
+		public:
+			void Enter()
+			{
+				Enter(m_Epochs.m_Epoch.load(std::memory_order_relaxed));
+			}
+
+			// Enter() with the epoch (@param seen) read earlier, it's checked again once published.
+			void Enter(unsigned seen)
+			{
+				assert(!IsInside());
+
+				unsigned epoch = seen;
+
+				// Has to be visible before any shared node is read. The epoch may have moved on since it was read,
+				// while nothing held it back, so publish until it's still current afterwards. From then on it moves once at most.
+				for (;;)
+				{
+					m_State.store(epoch << 1 | 1, std::memory_order_seq_cst);
+
+					const unsigned current = m_Epochs.m_Epoch.load(std::memory_order_seq_cst);
+
+					if (current == epoch)
+					{
+						break;
+					}
+
+					epoch = current;
+				}
+
+				if (epoch != m_Epoch)
+				{
+					// What was retired three or more epochs ago.
+					m_NumReclaimed += m_Epochs.Free(m_Limbo[epoch % kNumEpochs]);
+					m_Epoch = epoch;
+				}
+			}
+
+			void Exit()
+			{
+				assert(IsInside());
+
+				m_State.store(m_Epoch << 1, std::memory_order_release);
+			}
+
+			// Frees (@param address) once no thread can still see it, only while inside.
+			void Retire(void *address)
+			{
+				assert(IsInside() && address);
+
+				m_Limbo[m_Epoch % kNumEpochs].push_back(address);
+				m_NumRetired++;
+
+				if (++m_Retires % kAdvanceEvery == 0)
+				{
+					m_Epochs.TryAdvance();
+				}
+			}
+
+			bool IsInside() const { return (m_State.load(std::memory_order_relaxed) & 1) != 0; }
+			// The epoch it last entered in.
+			unsigned GetEpoch() const { return m_Epoch; }
+			size_t GetNumRetired() const { return m_NumRetired; }
+			size_t GetNumReclaimed() const { return m_NumReclaimed; }
+		};
+
+		// Enter()s for its scope.
+		class Guard
+		{
+			Guard(Guard const&);
+		public:
+			Guard(Participant &participant) :
+				m_Participant(participant)
+			{
+				m_Participant.Enter();
+			}
+
+			~Guard()
+			{
+				m_Participant.Exit();
+			}
+		private:
+			Participant &m_Participant;
+		};
+
+		EpochAllocator(A &alloc) :
+			m_Allocator(alloc),
+			m_Epoch(0),
+			m_Participants(nullptr)
+		{
+		}
+
+		// Frees everything still in limbo, no thread may be inside by now.
+		~EpochAllocator()
+		{
+			Participant *participant = m_Participants.load(std::memory_order_acquire);
+
+			while (participant)
+			{
+				assert(!participant->IsInside());
+
+				for (unsigned i = 0; i < kNumEpochs; i++)
+				{
+					Free(participant->m_Limbo[i]);
+				}
+
+				Participant *next = participant->m_Next;
+				delete participant;
+				participant = next;
+			}
+		}
+	private:
+		A &m_Allocator;
+		Lock m_Lock;
+		alignas(64) std::atomic<unsigned> m_Epoch;
+		std::atomic<Participant*> m_Participants;
+
+		// Empties (@param limbo), keeping its capacity for the next epoch. Returns how many nodes were freed.
+		size_t Free(std::vector<void*> &limbo)
+		{
+			const size_t count = limbo.size();
+
+			if (count == 0)
+			{
+				return 0;
+			}
+
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+
+				for (void *address : limbo)
+				{
+					m_Allocator.Deallocate(address);
+				}
+			}
+
+			limbo.clear();
+
+			return count;
+		}
+	public:
+		// Once per thread, the Participant lives as long as the EpochAllocator.
+		Participant& Join()
+		{
+			Participant *participant = new Participant(*this);
+			participant->m_Epoch = m_Epoch.load(std::memory_order_relaxed);
+			participant->m_Next = m_Participants.load(std::memory_order_relaxed);
+
+			while (!m_Participants.compare_exchange_weak(participant->m_Next, participant, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+
+			return *participant;
+		}
+
+		// Moves the epoch on if every thread inside has seen the current one. Retire() calls it now and then.
+		bool TryAdvance()
+		{
+			unsigned epoch = m_Epoch.load(std::memory_order_seq_cst);
+
+			for (Participant *participant = m_Participants.load(std::memory_order_acquire); participant; participant = participant->m_Next)
+			{
+				const unsigned state = participant->m_State.load(std::memory_order_seq_cst);
+
+				if ((state & 1) && (state >> 1) != epoch)
+				{
+					return false;
+				}
+			}
+
+			return m_Epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+		}
+
+		// Not part of any epoch, new nodes are private until published.
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			return m_Allocator.Allocate(size, alignment);
+		}
+
+		// Frees right away, for nodes that were never published.
+		void Deallocate(void *address)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			m_Allocator.Deallocate(address);
+		}
+
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		unsigned GetEpoch() const { return m_Epoch.load(std::memory_order_relaxed); }
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Allocator.h"
+
+namespace alloc
+{
+	// Tries Primary first and Fallback when it's out of memory, e.g. a StackAllocator backed by a FreeListAllocator.
+	// Deallocate asks Primary whether it owns the address, so Primary must have Owns().
+	// Holds references to both, which must outlive it. Calls bind statically, wrap it in VirtualAllocator for type erasure.
+	template<class Primary, class Fallback>
+	class FallbackAllocator
+	{
+		static_assert(IsAllocator<Primary>::value && IsAllocator<Fallback>::value, "Primary and Fallback must satisfy the allocator concept");
+
+		FallbackAllocator(FallbackAllocator const&);
+	public:
+		FallbackAllocator(Primary &primary, Fallback &fallback) :
+			m_Primary(primary),
+			m_Fallback(fallback)
+		{
+		}
+	private:
+		Primary &m_Primary;
+		Fallback &m_Fallback;
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			void *address = m_Primary.Allocate(size, alignment);
+
+			return address ? address : m_Fallback.Allocate(size, alignment);
+		}
+
+		void Deallocate(void *address)
+		{
+			if (m_Primary.Owns(address))
+			{
+				m_Primary.Deallocate(address);
+			}
+			else
+			{
+				m_Fallback.Deallocate(address);
+			}
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			if (m_Primary.Owns(address))
+			{
+				DeallocateSized(m_Primary, address, size, alignment);
+			}
+			else
+			{
+				DeallocateSized(m_Fallback, address, size, alignment);
+			}
+		}
+
+		bool Owns(void *address) const
+		{
+			return m_Primary.Owns(address) || alloc::Owns(m_Fallback, address);
+		}
+
+		Primary& GetPrimary() const { return m_Primary; }
+		Fallback& GetFallback() const { return m_Fallback; }
+	};
+}
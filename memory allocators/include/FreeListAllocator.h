@@ -4,11 +4,14 @@
 
 // Linked list of free blocks of memory:
 // Every free block contains the next free block.
+//
+// With alloc::Frees::Sized there's no header in front of allocations.
+// Blocks are then kept in multiples of sizeof FreeBlock, so the size passed to Deallocate finds the whole block.
 class FreeListAllocator : public Allocator
 {
 	FreeListAllocator(FreeListAllocator const&);
 public:
-	FreeListAllocator(size_t size);
+	FreeListAllocator(size_t size, alloc::Source const &source = alloc::Source(), alloc::Frees frees = alloc::Frees::Unsized);
 	~FreeListAllocator();
 private:
 	// Holds size and adjustment.
@@ -16,7 +19,7 @@ private:
 	{
 		// Allocation size.
 		size_t size;
-		// Allocation adjustment.
+		// Allocation adjustment, encoded, see alloc::math::StoreAdjustment().
 		uint8_t adjustment;
 	};
 
@@ -30,7 +33,24 @@ private:
 	};
 
 	FreeBlock *m_FreeBlock;
+	alloc::Frees m_Frees;
+
+	void* AllocateSized(size_t size, size_t alignment);
+	// Return a block to the list, merging it with adjacent free blocks.
+	void Free(uintptr_t block_start, size_t block_size);
+	// Take (@param size) bytes from the front of the free block at (@param block_start), or all of it if the rest can't be a block.
+	// Returns the bytes taken, 0 if there's no free block there or it's too small.
+	size_t TakeFrom(uintptr_t block_start, size_t size);
 public:
-	void* Allocate(size_t size, uint8_t alignment) override;
-	void Deallocate(void *address) override;
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address) final;
+	void Deallocate(void *address, size_t size, size_t alignment_not_used) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	// Grows into the free block right after the allocation, or gives the tail back when shrinking.
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
+
+	// Bytes usable at (@param address), at least the size it was allocated with.
+	// Only alloc::Frees::Unsized keeps the sizes, sized callers know them anyway.
+	size_t GetAllocationSize(void *address) const;
 };
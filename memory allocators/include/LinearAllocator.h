@@ -6,16 +6,37 @@
 // Individual deallocations aren't possible, instead use Clear() to clear member values.
 //
 // Maintains the starting address, the first free address and the total size.
+// With alloc::Backing::Virtual only address space is reserved, pages are committed as the pointer advances.
+// Clear() then decommits the pages above a high-water mark, which decays over several Clear() cycles,
+// so memory drops back after a burst without faulting pages in again on every cycle.
 class LinearAllocator : public Allocator
 {
 	LinearAllocator(LinearAllocator const&);
 public:
-	LinearAllocator(size_t size);
+	LinearAllocator(size_t size, alloc::Source const &source = alloc::Source());
 	~LinearAllocator();
 private:
 	void *m_CurrentPosition;
+	// Rolling high-water mark of bytes used between Clear() calls.
+	size_t m_HighWater;
 public:
-	void* Allocate(size_t size, uint8_t alignment) override;
-	void Deallocate(void *address_not_used) override;
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address_not_used) final;
+	void Deallocate(void *address_not_used, size_t size_not_used, size_t alignment_not_used) final;
+	// The last allocation grows or shrinks in place, others can only shrink in place.
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
 	void Clear();
+
+	// Allocation state to rewind to.
+	struct Marker
+	{
+		void *position;
+		size_t used_memory;
+		size_t allocations;
+	};
+
+	Marker GetMarker() const;
+	// Free everything allocated after (@param marker) was taken.
+	void FreeToMarker(Marker const &marker);
 };
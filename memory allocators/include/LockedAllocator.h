@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Allocator.h"
+#include "Locks.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace alloc
+{
+	// Lock statistics of a LockedAllocator.
+	struct LockStats
+	{
+		size_t acquisitions;
+		// Acquisitions that found the lock taken and had to wait.
+		size_t contended;
+		// Total time spent waiting in contended acquisitions.
+		unsigned long long wait_ns;
+	};
+
+	// Makes any allocator thread safe by taking Lock around every call, e.g. std::mutex, TicketLock or AdaptiveLock.
+	// Counts acquisitions and, when try_lock() fails, the contended ones and the time spent waiting,
+	// showing which allocators need sharding. The counters are updated under the lock, so they cost no extra atomics.
+	// The allocator must outlive it, and a call to it that bypasses the lock races with the ones that don't.
+	template<class A, class Lock = std::mutex>
+	class LockedAllocator
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		LockedAllocator(LockedAllocator const&);
+	public:
+		LockedAllocator(A &alloc) :
+			m_Allocator(alloc),
+			m_Acquisitions(0),
+			m_Contended(0),
+			m_WaitNanoseconds(0)
+		{
+		}
+	private:
+		A &m_Allocator;
+		mutable Lock m_Lock;
+		size_t m_Acquisitions;
+		size_t m_Contended;
+		unsigned long long m_WaitNanoseconds;
+
+		// Holds the lock for its scope, counting the acquisition.
+		class Scope
+		{
+			Scope(Scope const&);
+		public:
+			Scope(LockedAllocator &locked) :
+				m_Locked(locked)
+			{
+				if (m_Locked.m_Lock.try_lock())
+				{
+					m_Locked.m_Acquisitions++;
+					return;
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+
+				m_Locked.m_Lock.lock();
+
+				const auto waited = std::chrono::steady_clock::now() - start;
+
+				m_Locked.m_Acquisitions++;
+				m_Locked.m_Contended++;
+				m_Locked.m_WaitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+			}
+
+			~Scope()
+			{
+				m_Locked.m_Lock.unlock();
+			}
+		private:
+			LockedAllocator &m_Locked;
+		};
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			Scope scope(*this);
+			return m_Allocator.Allocate(size, alignment);
+		}
+
+		void Deallocate(void *address)
+		{
+			Scope scope(*this);
+			m_Allocator.Deallocate(address);
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			Scope scope(*this);
+			DeallocateSized(m_Allocator, address, size, alignment);
+		}
+
+		Allocation AllocateAtLeast(size_t size, size_t alignment)
+		{
+			Scope scope(*this);
+			return alloc::AllocateAtLeast(m_Allocator, size, alignment);
+		}
+
+		void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+		{
+			Scope scope(*this);
+			return alloc::Reallocate(m_Allocator, address, old_size, new_size, alignment);
+		}
+
+		// Not locked, ownership is a range check on memory that doesn't move.
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		// Consistent snapshot, taking the lock without counting it.
+		LockStats GetStats() const
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			return{ m_Acquisitions, m_Contended, m_WaitNanoseconds };
+		}
+
+		// The allocator's statistics, read under the lock without counting it.
+		size_t GetUsedMemory() const
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			return m_Allocator.GetUsedMemory();
+		}
+
+		size_t GetNumAllocations() const
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+			return m_Allocator.GetNumAllocations();
+		}
+
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
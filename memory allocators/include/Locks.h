@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Locks for LockedAllocator, all with lock(), try_lock() and unlock() like std::mutex, which works as well.
+namespace alloc
+{
+	// Tell the CPU we're spinning, so it backs off the memory bus and gives the core to a sibling hyperthread.
+	inline void CpuRelax()
+	{
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	// FIFO spinlock: threads take a ticket and spin until it's served, so none of them starves.
+	// Best for short critical sections with a thread per core. A preempted holder stalls everyone behind it,
+	// so after kYieldAfter spins waiters yield, letting it run when there are more threads than cores.
+	class TicketLock
+	{
+		TicketLock(TicketLock const&);
+	public:
+		TicketLock() :
+			m_Next(0),
+			m_Serving(0)
+		{
+		}
+	private:
+		static const unsigned kYieldAfter = 128;
+
+		std::atomic<unsigned> m_Next;
+		std::atomic<unsigned> m_Serving;
+	public:
+		void lock()
+		{
+			const unsigned ticket = m_Next.fetch_add(1, std::memory_order_relaxed);
+
+			for (unsigned spins = 0; m_Serving.load(std::memory_order_acquire) != ticket; spins++)
+			{
+				if (spins < kYieldAfter)
+				{
+					CpuRelax();
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		bool try_lock()
+		{
+			// Acquire pairs with the release in unlock(), the CAS below only orders m_Next.
+			unsigned serving = m_Serving.load(std::memory_order_acquire);
+
+			// Only free if nobody holds or waits for a ticket.
+			return m_Next.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+
+		void unlock()
+		{
+			m_Serving.store(m_Serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	// Spins for a while in case the holder is about to finish, then parks the thread in the OS.
+	// Like glibc's adaptive mutex, a fair default when critical section lengths vary.
+	class AdaptiveLock
+	{
+		AdaptiveLock(AdaptiveLock const&);
+	public:
+		AdaptiveLock(unsigned spin_count = 100) :
+			m_SpinCount(spin_count)
+		{
+		}
+	private:
+		std::mutex m_Mutex;
+		unsigned m_SpinCount;
+	public:
+		void lock()
+		{
+			for (unsigned i = 0; i < m_SpinCount; i++)
+			{
+				if (m_Mutex.try_lock())
+				{
+					return;
+				}
+
+				CpuRelax();
+			}
+
+			m_Mutex.lock();
+		}
+
+		bool try_lock() { return m_Mutex.try_lock(); }
+		void unlock() { m_Mutex.unlock(); }
+	};
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Allocator.h"
+#include "LinearAllocator.h"
+#include "PoolAllocator.h"
+
+#include <memory_resource>
+#include <new>
+
+namespace alloc
+{
+	namespace detail
+	{
+		// memory_resource allows 0 byte requests, the allocators don't.
+		inline size_t ResourceSize(size_t bytes) { return bytes ? bytes : 1; }
+	}
+
+	// std::pmr::memory_resource over an allocator, so pmr containers can use it.
+	// Out of memory throws std::bad_alloc, as memory_resource requires.
+	// Deallocations pass the size and alignment on, so allocators in alloc::Frees::Sized mode work too.
+	// With a concrete A the calls bind statically, the default takes any Allocator.
+	template<class A = Allocator>
+	class MemoryResource : public std::pmr::memory_resource
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+	public:
+		MemoryResource(A &alloc) :
+			m_Allocator(alloc)
+		{
+		}
+	private:
+		A &m_Allocator;
+
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			void *address = m_Allocator.Allocate(detail::ResourceSize(bytes), alignment);
+
+			if (!address)
+			{
+				throw std::bad_alloc();
+			}
+
+			return address;
+		}
+
+		void do_deallocate(void *address, size_t bytes, size_t alignment) override
+		{
+			DeallocateSized(m_Allocator, address, detail::ResourceSize(bytes), alignment);
+		}
+
+		// Resources over the same allocator can free each other's memory.
+		bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override
+		{
+			const MemoryResource *const resource = dynamic_cast<const MemoryResource*>(&other);
+
+			return resource && &resource->m_Allocator == &m_Allocator;
+		}
+	public:
+		A& GetAllocator() const { return m_Allocator; }
+	};
+
+	// Arena resource like std::pmr::monotonic_buffer_resource, on a LinearAllocator.
+	// Requests that don't fit go to (@param upstream), and are given back to it on deallocation.
+	// Deallocations from the arena do nothing, Clear() frees the whole arena.
+	class LinearResource : public std::pmr::memory_resource
+	{
+		LinearResource(LinearResource const&);
+	public:
+		LinearResource(size_t size, alloc::Source const &source = alloc::Source(), std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+		~LinearResource();
+	private:
+		LinearAllocator m_Arena;
+		std::pmr::memory_resource *m_Upstream;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void *address, size_t bytes, size_t alignment) override;
+		bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override;
+	public:
+		// Only the arena is cleared, memory from upstream must have been deallocated.
+		void Clear();
+
+		LinearAllocator& GetArena() { return m_Arena; }
+	};
+
+	// Resource for node based containers, e.g. pmr::list, pmr::map or pmr::unordered_map, on a PoolAllocator.
+	// Requests up to the object size and alignment come from the pool, the rest from (@param upstream).
+	class PoolResource : public std::pmr::memory_resource
+	{
+		PoolResource(PoolResource const&);
+	public:
+		PoolResource(size_t size, size_t obj_size, size_t obj_alignment, alloc::Source const &source = alloc::Source(), std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+		~PoolResource();
+	private:
+		PoolAllocator m_Pool;
+		size_t m_ObjectSize;
+		size_t m_ObjectAlignment;
+		std::pmr::memory_resource *m_Upstream;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void *address, size_t bytes, size_t alignment) override;
+		bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override;
+	public:
+		PoolAllocator& GetPool() { return m_Pool; }
+	};
+}
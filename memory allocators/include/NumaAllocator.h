@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <functional>
+#include <vector>
+
+// Registry of one allocator per NUMA node, routing Allocate to the node the calling thread runs on.
+// Deallocate goes back to whichever node allocator the address lies in.
+// On single node machines there's simply one allocator.
+//
+// Node allocators must be thread-safe if several threads share a node.
+// Counters are kept by the node allocators, not by the registry.
+class NumaAllocator : public Allocator
+{
+	NumaAllocator(NumaAllocator const&);
+public:
+	// (@param factory) creates the allocator for a node, e.g. with alloc::Source::Placed(backing, alloc::vm::Numa::Bind, node).
+	NumaAllocator(std::function<Allocator*(unsigned node)> const &factory);
+	~NumaAllocator();
+private:
+	std::vector<Allocator*> m_Nodes;
+
+	Allocator& NodeFromAddress(void *address) const;
+	Allocator& NodeForThread() const;
+public:
+	void* Allocate(size_t size, size_t alignment) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	// Stays on the node the allocation was made on.
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	// Owned by any of the node allocators.
+	bool Owns(void *address) const final;
+	void Deallocate(void *address) final;
+	void Deallocate(void *address, size_t size, size_t alignment) final;
+
+	Allocator& GetNodeAllocator(unsigned node) const;
+	unsigned GetNumNodes() const { return static_cast<unsigned>(m_Nodes.size()); }
+};
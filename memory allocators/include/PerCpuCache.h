@@ -0,0 +1,409 @@
+#pragma once
+
+#include "Allocator.h"
+#include "Rseq.h"
+#include "VirtualMemory.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace alloc
+{
+	namespace detail
+	{
+		// Handed out to threads in order of their first call, shared by every PerCpuCache.
+		inline unsigned ThreadSlot()
+		{
+			static std::atomic<unsigned> s_NextSlot(0);
+			thread_local unsigned t_Slot = s_NextSlot.fetch_add(1, std::memory_order_relaxed);
+
+			return t_Slot;
+		}
+	}
+
+	// How PerCpuCache finds a thread's slot, from the fastest to the most portable.
+	enum class SlotBy
+	{
+		// The slot of the CPU it runs on, popped and pushed in restartable sequences, with no atomics at all. Linux x86-64 only.
+		Rseq,
+		// The slot of the CPU it runs on, taken with an exchange that nobody else contends for,
+		// unless the thread was preempted or moved in between, in which case it goes to the allocator directly.
+		Cpu,
+		// A slot per thread, handed out round robin and taken with the same exchange, shared once threads outnumber slots.
+		Thread
+	};
+
+	// Caches objects of one size class per CPU in front of an allocator, e.g. a PoolAllocator or a Bucketizer.
+	// A slot holds up to (@param capacity) objects, refilled from and flushed to the allocator half at a time under Lock,
+	// so the cached memory grows with the number of cores, however many threads there are.
+	// Slots are found by the fastest SlotBy the platform has, Thread where CPU numbers aren't available.
+	// Objects in the slots count as allocated in A until Flush(), which the destructor calls, so A must outlive the cache.
+	template<class A, class Lock = std::mutex>
+	class PerCpuCache
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		PerCpuCache(PerCpuCache const&);
+	public:
+		// (@param slots) defaults to one per hardware thread, (@param slot_by) is the fastest way to find slots it may use.
+		// Rseq needs a slot for every CPU number, so it falls back to Cpu with fewer slots than that.
+		PerCpuCache(A &alloc, size_t object_size, size_t object_alignment, unsigned capacity = 64, unsigned slots = 0, SlotBy slot_by = SlotBy::Rseq) :
+			m_Allocator(alloc),
+			m_ObjectSize(object_size),
+			m_ObjectAlignment(object_alignment),
+			m_Capacity(capacity),
+			m_NumSlots(slots ? slots : std::thread::hardware_concurrency()),
+			m_SlotBy(SlotBy::Thread)
+		{
+			assert(m_Capacity >= 2);
+
+			if (m_NumSlots == 0)
+			{
+				m_NumSlots = 1;
+			}
+
+#ifdef ALLOC_RSEQ
+			if (slot_by == SlotBy::Rseq && rseq::Registered())
+			{
+				const unsigned num_cpus = rseq::NumCpus();
+
+				if (slots == 0 && m_NumSlots < num_cpus)
+				{
+					m_NumSlots = num_cpus;
+				}
+
+				if (m_NumSlots >= num_cpus)
+				{
+					m_SlotBy = SlotBy::Rseq;
+				}
+			}
+#endif
+
+			if (m_SlotBy != SlotBy::Rseq && slot_by != SlotBy::Thread && vm::CurrentCpuSupported())
+			{
+				m_SlotBy = SlotBy::Cpu;
+			}
+
+			m_Slots.reset(new Slot[m_NumSlots]);
+			m_Objects.reset(new void*[m_NumSlots * m_Capacity]);
+
+			for (unsigned i = 0; i < m_NumSlots; i++)
+			{
+				m_Slots[i].objects = &m_Objects[i * m_Capacity];
+			}
+		}
+
+		// No thread may use it by now.
+		~PerCpuCache()
+		{
+			Flush();
+		}
+	private:
+		// Aligned to a cache line, a CPU's count changes on every call and would keep taking the line from its neighbours.
+		struct alignas(64) Slot
+		{
+			Slot() :
+				busy(false),
+				count(0),
+				objects(nullptr)
+			{
+			}
+
+			// Not used with SlotBy::Rseq.
+			std::atomic<bool> busy;
+			size_t count;
+			void **objects;
+		};
+
+		// Objects moved at once on the Rseq paths, which collect them on the stack.
+		static const unsigned kMaxBatch = 64;
+
+		A &m_Allocator;
+		Lock m_Lock;
+		size_t m_ObjectSize;
+		size_t m_ObjectAlignment;
+		unsigned m_Capacity;
+		unsigned m_NumSlots;
+		SlotBy m_SlotBy;
+		std::unique_ptr<Slot[]> m_Slots;
+		std::unique_ptr<void*[]> m_Objects;
+
+		Slot& SlotForThread()
+		{
+			return m_Slots[(m_SlotBy == SlotBy::Cpu ? vm::CurrentCpu() : detail::ThreadSlot()) % m_NumSlots];
+		}
+
+		// With the slot taken.
+		void Refill(Slot &slot)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+
+			while (slot.count < m_Capacity / 2)
+			{
+				void *address = m_Allocator.Allocate(m_ObjectSize, m_ObjectAlignment);
+
+				if (!address)
+				{
+					break;
+				}
+
+				slot.objects[slot.count++] = address;
+			}
+		}
+
+		// With the slot taken, the oldest objects go first, the recently used ones are likelier in cache.
+		void Flush(Slot &slot, size_t count)
+		{
+			std::lock_guard<Lock> guard(m_Lock);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				m_Allocator.Deallocate(slot.objects[i]);
+			}
+
+			slot.count -= count;
+
+			for (size_t i = 0; i < slot.count; i++)
+			{
+				slot.objects[i] = slot.objects[i + count];
+			}
+		}
+
+#ifdef ALLOC_RSEQ
+		size_t BatchSize() const
+		{
+			return m_Capacity / 2 < kMaxBatch ? m_Capacity / 2 : kMaxBatch;
+		}
+
+		// Pops from or pushes to the current CPU's slot, retried until it runs through on one CPU.
+		// kStopped if the slot is empty or full, or the CPU has no slot.
+		rseq::Result PopRseq(void **address)
+		{
+			for (;;)
+			{
+				const unsigned cpu = rseq::CpuStart();
+
+				if (cpu >= m_NumSlots)
+				{
+					return rseq::kStopped;
+				}
+
+				const rseq::Result result = rseq::Pop(&m_Slots[cpu].count, m_Slots[cpu].objects, cpu, address);
+
+				if (result != rseq::kAborted)
+				{
+					return result;
+				}
+			}
+		}
+
+		rseq::Result PushRseq(void *address)
+		{
+			for (;;)
+			{
+				const unsigned cpu = rseq::CpuStart();
+
+				if (cpu >= m_NumSlots)
+				{
+					return rseq::kStopped;
+				}
+
+				const rseq::Result result = rseq::Push(&m_Slots[cpu].count, m_Slots[cpu].objects, m_Capacity, cpu, address);
+
+				if (result != rseq::kAborted)
+				{
+					return result;
+				}
+			}
+		}
+
+		// The slot was empty. Allocates a batch under the lock, returns one and pushes the rest,
+		// whatever doesn't fit anymore, e.g. after a move to a fuller CPU, goes back.
+		void* RefillRseq()
+		{
+			void *batch[kMaxBatch];
+			size_t count = 0;
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+
+				while (count < BatchSize())
+				{
+					void *address = m_Allocator.Allocate(m_ObjectSize, m_ObjectAlignment);
+
+					if (!address)
+					{
+						break;
+					}
+
+					batch[count++] = address;
+				}
+			}
+
+			if (count == 0)
+			{
+				return nullptr;
+			}
+
+			size_t pushed = 1;
+
+			while (pushed < count && PushRseq(batch[pushed]) == rseq::kDone)
+			{
+				pushed++;
+			}
+
+			if (pushed < count)
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+
+				for (; pushed < count; pushed++)
+				{
+					m_Allocator.Deallocate(batch[pushed]);
+				}
+			}
+
+			return batch[0];
+		}
+
+		// The slot was full. Pops a batch and frees it with (@param address) under the lock.
+		// The newest objects go, unlike with the other SlotBys, taking the oldest would move the rest.
+		void FlushRseq(void *address)
+		{
+			void *batch[kMaxBatch];
+			size_t count = 0;
+
+			while (count < BatchSize() && PopRseq(&batch[count]) == rseq::kDone)
+			{
+				count++;
+			}
+
+			std::lock_guard<Lock> guard(m_Lock);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				m_Allocator.Deallocate(batch[i]);
+			}
+
+			m_Allocator.Deallocate(address);
+		}
+#endif
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			assert(size <= m_ObjectSize && alignment <= m_ObjectAlignment);
+
+#ifdef ALLOC_RSEQ
+			if (m_SlotBy == SlotBy::Rseq)
+			{
+				void *address;
+
+				return PopRseq(&address) == rseq::kDone ? address : RefillRseq();
+			}
+#endif
+
+			Slot &slot = SlotForThread();
+
+			if (!slot.busy.exchange(true, std::memory_order_acquire))
+			{
+				if (slot.count == 0)
+				{
+					Refill(slot);
+				}
+
+				void *address = slot.count ? slot.objects[--slot.count] : nullptr;
+
+				slot.busy.store(false, std::memory_order_release);
+
+				return address;
+			}
+
+			std::lock_guard<Lock> guard(m_Lock);
+			return m_Allocator.Allocate(m_ObjectSize, m_ObjectAlignment);
+		}
+
+		void Deallocate(void *address)
+		{
+			if (!address)
+			{
+				return;
+			}
+
+#ifdef ALLOC_RSEQ
+			if (m_SlotBy == SlotBy::Rseq)
+			{
+				if (PushRseq(address) != rseq::kDone)
+				{
+					FlushRseq(address);
+				}
+
+				return;
+			}
+#endif
+
+			Slot &slot = SlotForThread();
+
+			if (!slot.busy.exchange(true, std::memory_order_acquire))
+			{
+				if (slot.count == m_Capacity)
+				{
+					Flush(slot, m_Capacity / 2);
+				}
+
+				slot.objects[slot.count++] = address;
+
+				slot.busy.store(false, std::memory_order_release);
+
+				return;
+			}
+
+			std::lock_guard<Lock> guard(m_Lock);
+			m_Allocator.Deallocate(address);
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			assert(size <= m_ObjectSize && alignment <= m_ObjectAlignment);
+
+			Deallocate(address);
+		}
+
+		Allocation AllocateAtLeast(size_t size, size_t alignment)
+		{
+			void *address = Allocate(size, alignment);
+
+			return{ address, address ? m_ObjectSize : 0 };
+		}
+
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		// Returns every cached object to the allocator, no thread may use the cache meanwhile.
+		void Flush()
+		{
+			for (unsigned i = 0; i < m_NumSlots; i++)
+			{
+				Flush(m_Slots[i], m_Slots[i].count);
+			}
+		}
+
+		// Objects sitting in the slots, only exact while no thread uses the cache.
+		size_t GetCachedObjects() const
+		{
+			size_t count = 0;
+
+			for (unsigned i = 0; i < m_NumSlots; i++)
+			{
+				count += m_Slots[i].count;
+			}
+
+			return count;
+		}
+
+		unsigned GetNumSlots() const { return m_NumSlots; }
+		SlotBy GetSlotBy() const { return m_SlotBy; }
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
@@ -6,13 +6,19 @@ class PoolAllocator : public Allocator
 {
 	PoolAllocator(PoolAllocator const&);
 public:
-	PoolAllocator(size_t size, size_t obj_size, uint8_t obj_alignment);
+	PoolAllocator(size_t size, size_t obj_size, size_t obj_alignment, alloc::Source const &source = alloc::Source());
 	~PoolAllocator();
 private:
 	size_t m_ObjectSize;
-	uint8_t m_ObjectAlignment;
+	size_t m_ObjectAlignment;
 	void **m_FreeList;
 public:
-	void* Allocate(size_t size, uint8_t alignment) override;
-	void Deallocate(void *address) override;
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address) final;
+	void Deallocate(void *address, size_t size, size_t alignment_not_used) final;
+	// Any size and alignment up to the object's gets a whole object.
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	// Returns (@param address) while the object size fits, nullptr otherwise.
+	void* Reallocate(void *address, size_t old_size_not_used, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
 };
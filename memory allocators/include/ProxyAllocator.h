@@ -11,6 +11,10 @@ public:
 private:
 	Allocator &m_Allocator;
 public:
-	void* Allocate(size_t size, uint8_t alignment) override;
-	void Deallocate(void *address) override;
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address) final;
+	void Deallocate(void *address, size_t size, size_t alignment) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return m_Allocator.Owns(address); }
 };
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <atomic>
+#include <thread>
+
+namespace alloc
+{
+	// Lets other threads free into a single-threaded allocator, for memory allocated on one thread and freed on another.
+	// The owner thread, the one that constructed it until SetOwner(), calls the allocator directly with no atomics or locks.
+	// Other threads only push what they free onto a lock-free list, the owner takes the whole list
+	// and frees it in one batch on its next Allocate, when the list isn't empty, or on Collect().
+	//
+	// Freed blocks hold the list link, so allocations are rounded up to a pointer and aligned to one. Remote frees are unsized.
+	// Only Deallocate may be called off the owner thread. Holds a reference to the allocator, which must outlive it.
+	template<class A>
+	class RemoteFreeAllocator
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		RemoteFreeAllocator(RemoteFreeAllocator const&);
+	public:
+		RemoteFreeAllocator(A &alloc) :
+			m_Allocator(alloc),
+			m_Owner(std::this_thread::get_id()),
+			m_RemoteFrees(nullptr),
+			m_NumRemoteFrees(0)
+		{
+		}
+
+		// Whatever is still queued is freed, no thread may free concurrently by now.
+		~RemoteFreeAllocator()
+		{
+			Collect();
+		}
+	private:
+		struct Node
+		{
+			Node *next;
+		};
+
+		A &m_Allocator;
+		// Read by every Deallocate, written only by SetOwner().
+		std::atomic<std::thread::id> m_Owner;
+		// Only the remote threads write it, it doesn't share a cache line with the owner's fields.
+		alignas(64) std::atomic<Node*> m_RemoteFrees;
+		alignas(64) size_t m_NumRemoteFrees;
+
+		static size_t LinkSize(size_t size)
+		{
+			return size < sizeof(Node) ? sizeof(Node) : size;
+		}
+
+		static size_t LinkAlignment(size_t alignment)
+		{
+			return alignment < alignof(Node) ? alignof(Node) : alignment;
+		}
+
+		bool IsOwner() const
+		{
+			return std::this_thread::get_id() == m_Owner.load(std::memory_order_relaxed);
+		}
+
+		void PushRemote(void *address)
+		{
+			Node *node = static_cast<Node*>(address);
+			node->next = m_RemoteFrees.load(std::memory_order_relaxed);
+
+			while (!m_RemoteFrees.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		// A plain load on x86, the exchange only happens when there's something to free.
+		void CollectIfPending()
+		{
+			if (m_RemoteFrees.load(std::memory_order_relaxed))
+			{
+				Collect();
+			}
+		}
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			assert(IsOwner());
+
+			CollectIfPending();
+
+			return m_Allocator.Allocate(LinkSize(size), LinkAlignment(alignment));
+		}
+
+		// From the owner it frees right away, from other threads it's queued for the owner.
+		void Deallocate(void *address)
+		{
+			if (IsOwner())
+			{
+				m_Allocator.Deallocate(address);
+			}
+			else if (address)
+			{
+				PushRemote(address);
+			}
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			if (IsOwner())
+			{
+				DeallocateSized(m_Allocator, address, LinkSize(size), LinkAlignment(alignment));
+			}
+			else if (address)
+			{
+				PushRemote(address);
+			}
+		}
+
+		Allocation AllocateAtLeast(size_t size, size_t alignment)
+		{
+			assert(IsOwner());
+
+			CollectIfPending();
+
+			return alloc::AllocateAtLeast(m_Allocator, LinkSize(size), LinkAlignment(alignment));
+		}
+
+		void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+		{
+			assert(IsOwner());
+
+			CollectIfPending();
+
+			return alloc::Reallocate(m_Allocator, address, LinkSize(old_size), LinkSize(new_size), LinkAlignment(alignment));
+		}
+
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		// Frees everything other threads queued so far, on the owner thread.
+		void Collect()
+		{
+			Node *node = m_RemoteFrees.exchange(nullptr, std::memory_order_acquire);
+
+			while (node)
+			{
+				Node *next = node->next;
+				m_Allocator.Deallocate(node);
+				m_NumRemoteFrees++;
+				node = next;
+			}
+		}
+
+		// Hands the allocator over to the calling thread, the old owner must not use it anymore.
+		// Other threads may keep freeing meanwhile, a free that still sees the old owner is queued like any remote one.
+		void SetOwner()
+		{
+			m_Owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		}
+
+		// Remote frees collected so far, counted by the owner.
+		size_t GetNumRemoteFrees() const { return m_NumRemoteFrees; }
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
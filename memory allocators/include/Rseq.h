@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+
+// Restartable sequences, Linux x86-64 only: a short run of instructions ending in a single committing store,
+// which the kernel restarts at an abort handler if the thread is preempted, migrated or signalled in between.
+// So a per-CPU structure can be changed with plain loads and stores, as if the thread had the CPU to itself.
+// glibc 2.35 and later registers every thread, the area is found at __rseq_offset from the thread pointer.
+// Left out under ThreadSanitizer, which can't see objects handed over through the asm.
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__) && defined(__has_include) && !defined(__SANITIZE_THREAD__)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#include <unistd.h>
+#define ALLOC_RSEQ 1
+#endif
+#endif
+
+#ifdef ALLOC_RSEQ
+
+namespace alloc { namespace rseq
+{
+	enum Result
+	{
+		kDone,
+		// Nothing to pop, or no room to push, nothing was changed.
+		kStopped,
+		// Preempted, migrated or signalled, nothing was changed, retry with the current CPU.
+		kAborted
+	};
+
+	inline struct ::rseq* Area()
+	{
+		return reinterpret_cast<struct ::rseq*>(static_cast<char*>(__builtin_thread_pointer()) + __rseq_offset);
+	}
+
+	// Whether the calling thread is registered. False on kernels before 4.18, older glibc or with glibc.pthread.rseq=0.
+	inline bool Registered()
+	{
+		return __rseq_size != 0 && static_cast<int>(Area()->cpu_id) >= 0;
+	}
+
+	// CPU the sequence is about to run on, checked again inside it.
+	inline unsigned CpuStart()
+	{
+		return *static_cast<volatile unsigned*>(&Area()->cpu_id_start);
+	}
+
+	// CPU numbers are below it.
+	inline unsigned NumCpus()
+	{
+		const long count = sysconf(_SC_NPROCESSORS_CONF);
+		return count > 0 ? static_cast<unsigned>(count) : 1u;
+	}
+
+	// Descriptor of the sequence from 1 to 2 in its own section, the abort handler 4 behind the signature the kernel checks.
+#define ALLOC_RSEQ_BEGIN \
+	".pushsection __rseq_cs, \"aw\"\n\t" \
+	".balign 32\n\t" \
+	"3:\n\t" \
+	".long 0x0, 0x0\n\t" \
+	".quad 1f, (2f - 1f), 4f\n\t" \
+	".popsection\n\t" \
+	".pushsection __rseq_cs_ptr_array, \"aw\"\n\t" \
+	".quad 3b\n\t" \
+	".popsection\n\t" \
+	"leaq 3b(%%rip), %%rax\n\t" \
+	"movq %%rax, %[rseq_cs]\n\t" \
+	"1:\n\t" \
+	"cmpl %[cpu], %[cpu_id]\n\t" \
+	"jnz %l[aborted]\n\t"
+
+#define ALLOC_RSEQ_END \
+	"2:\n\t" \
+	".pushsection __rseq_failure, \"ax\"\n\t" \
+	".byte 0x0f, 0xb9, 0x3d\n\t" \
+	".long 0x53053053\n\t" \
+	"4:\n\t" \
+	"jmp %l[aborted]\n\t" \
+	".popsection\n\t"
+
+	// On (@param cpu), takes (@param result) from the top of (@param objects) holding (@param count).
+	inline Result Pop(size_t *count, void **objects, unsigned cpu, void **result)
+	{
+		struct ::rseq *area = Area();
+
+		__asm__ __volatile__ goto(
+			ALLOC_RSEQ_BEGIN
+			"movq %[count], %%rcx\n\t"
+			"testq %%rcx, %%rcx\n\t"
+			"jz %l[stopped]\n\t"
+			"movq -8(%[objects], %%rcx, 8), %%rax\n\t"
+			"movq %%rax, %[result]\n\t"
+			"decq %%rcx\n\t"
+			// Commits.
+			"movq %%rcx, %[count]\n\t"
+			ALLOC_RSEQ_END
+			:
+			: [cpu] "r" (cpu), [cpu_id] "m" (area->cpu_id), [rseq_cs] "m" (area->rseq_cs),
+			  [count] "m" (*count), [objects] "r" (objects), [result] "m" (*result)
+			: "memory", "cc", "rax", "rcx"
+			: stopped, aborted);
+
+		return kDone;
+	stopped:
+		return kStopped;
+	aborted:
+		return kAborted;
+	}
+
+	// On (@param cpu), puts (@param object) on top of (@param objects) holding (@param count), unless it has (@param capacity).
+	inline Result Push(size_t *count, void **objects, size_t capacity, unsigned cpu, void *object)
+	{
+		struct ::rseq *area = Area();
+
+		__asm__ __volatile__ goto(
+			ALLOC_RSEQ_BEGIN
+			"movq %[count], %%rcx\n\t"
+			"cmpq %[capacity], %%rcx\n\t"
+			"jae %l[stopped]\n\t"
+			// Past the count, so it's only taken once committed.
+			"movq %[object], (%[objects], %%rcx, 8)\n\t"
+			"incq %%rcx\n\t"
+			// Commits.
+			"movq %%rcx, %[count]\n\t"
+			ALLOC_RSEQ_END
+			:
+			: [cpu] "r" (cpu), [cpu_id] "m" (area->cpu_id), [rseq_cs] "m" (area->rseq_cs),
+			  [count] "m" (*count), [objects] "r" (objects), [capacity] "r" (capacity), [object] "r" (object)
+			: "memory", "cc", "rax", "rcx"
+			: stopped, aborted);
+
+		return kDone;
+	stopped:
+		return kStopped;
+	aborted:
+		return kAborted;
+	}
+
+#undef ALLOC_RSEQ_BEGIN
+#undef ALLOC_RSEQ_END
+} }
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "LinearAllocator.h"
+
+#include <memory>
+
+namespace alloc
+{
+	// Scratch arenas per thread.
+	// Two is enough for a function that uses its own scratch while returning results into the caller's.
+	const unsigned kScratchArenas = 2;
+	// Address space reserved per scratch arena, pages are only committed when used.
+	const size_t kScratchReserve = 64 * 1024 * 1024;
+
+	// Temporary allocations on a thread-local arena, freed when the Scratch goes out of scope.
+	// Scopes on the same arena must be nested, like a stack.
+	// When every thread-local arena conflicts, it gets an arena of its own instead, released with it.
+	class Scratch
+	{
+		Scratch(Scratch const&);
+		Scratch& operator=(Scratch const&);
+	public:
+		Scratch(LinearAllocator &arena);
+		// Takes ownership of (@param arena).
+		explicit Scratch(std::unique_ptr<LinearAllocator> arena);
+		Scratch(Scratch &&other);
+		~Scratch();
+	private:
+		LinearAllocator *m_Arena;
+		LinearAllocator::Marker m_Marker;
+		std::unique_ptr<LinearAllocator> m_OwnArena;
+	public:
+		void* Allocate(size_t size, size_t alignment = 4) { return m_Arena->Allocate(size, alignment); }
+		LinearAllocator* GetAllocator() const { return m_Arena; }
+		// Whether it got an arena of its own because every thread-local one conflicted.
+		bool OwnsArena() const { return m_OwnArena != nullptr; }
+	};
+
+	namespace detail
+	{
+		Scratch GetScratch(Allocator const *const *conflicts, size_t count);
+	}
+
+	// Scratch on a thread-local arena that isn't any of (@param conflicts).
+	// Pass the arenas the caller may still be allocating results into, e.g. its own scratch.
+	template<class...Conflicts>
+	Scratch GetScratch(Conflicts*...conflicts)
+	{
+		// Leading nullptr keeps the array non-empty when there are no conflicts.
+		Allocator const *const list[] = { nullptr, conflicts... };
+
+		return detail::GetScratch(list + 1, sizeof...(conflicts));
+	}
+}
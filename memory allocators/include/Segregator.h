@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Allocator.h"
+
+namespace alloc
+{
+	// Sends allocations up to Threshold bytes to Small and bigger ones to Large,
+	// e.g. pools for small objects and a FreeListAllocator for the rest.
+	// Unsized Deallocate asks Small whether it owns the address, sized Deallocate goes by the size.
+	// Holds references to both, which must outlive it. Calls bind statically, wrap it in VirtualAllocator for type erasure.
+	template<size_t Threshold, class Small, class Large>
+	class Segregator
+	{
+		static_assert(IsAllocator<Small>::value && IsAllocator<Large>::value, "Small and Large must satisfy the allocator concept");
+
+		Segregator(Segregator const&);
+	public:
+		Segregator(Small &small, Large &large) :
+			m_Small(small),
+			m_Large(large)
+		{
+		}
+	private:
+		Small &m_Small;
+		Large &m_Large;
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			return size <= Threshold ? m_Small.Allocate(size, alignment) : m_Large.Allocate(size, alignment);
+		}
+
+		void Deallocate(void *address)
+		{
+			if (m_Small.Owns(address))
+			{
+				m_Small.Deallocate(address);
+			}
+			else
+			{
+				m_Large.Deallocate(address);
+			}
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			if (size <= Threshold)
+			{
+				DeallocateSized(m_Small, address, size, alignment);
+			}
+			else
+			{
+				DeallocateSized(m_Large, address, size, alignment);
+			}
+		}
+
+		bool Owns(void *address) const
+		{
+			return m_Small.Owns(address) || alloc::Owns(m_Large, address);
+		}
+
+		Small& GetSmall() const { return m_Small; }
+		Large& GetLarge() const { return m_Large; }
+	};
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Allocator.h"
+#include "FreeListAllocator.h"
+#include "LockedAllocator.h"
+
+#include <memory>
+
+namespace alloc
+{
+	// How threads are spread over the shards of a ShardedAllocator.
+	enum class ShardBy : uint8_t
+	{
+		// The CPU the thread runs on, threads on different cores rarely share a lock.
+		// RoundRobin where CPU numbers aren't available.
+		Cpu,
+		// Each thread gets the next shard the first time it allocates.
+		RoundRobin
+	};
+}
+
+// K FreeListAllocators, each behind its own lock, splitting one block of memory between them.
+// Threads allocate from their shard, and from the others once it's full.
+// Deallocate goes to the shard owning the address, found from the address alone, whichever thread frees it.
+//
+// Allocations aren't counted in the base, GetUsedMemory() and GetNumAllocations() sum up the shards instead.
+class ShardedAllocator : public Allocator
+{
+	ShardedAllocator(ShardedAllocator const&);
+public:
+	// (@param shards) defaults to one per hardware thread.
+	ShardedAllocator(size_t size, unsigned shards = 0, alloc::ShardBy shard_by = alloc::ShardBy::Cpu, alloc::Source const &source = alloc::Source());
+	~ShardedAllocator();
+private:
+	typedef alloc::LockedAllocator<FreeListAllocator, alloc::AdaptiveLock> LockedArena;
+
+	// On its own cache lines, so threads working on neighbouring shards don't slow each other down.
+	struct alignas(64) Shard
+	{
+		Shard(size_t size, void *start);
+
+		FreeListAllocator arena;
+		LockedArena locked;
+	};
+
+	std::unique_ptr<std::unique_ptr<Shard>[]> m_Shards;
+	unsigned m_NumShards;
+	size_t m_ShardSize;
+	alloc::ShardBy m_ShardBy;
+
+	// Shard for the calling thread.
+	unsigned ShardForThread() const;
+	Shard& ShardFromAddress(void *address) const;
+public:
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *address) final;
+	void Deallocate(void *address, size_t size, size_t alignment) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	// Resizes within the owning shard, moves to another one if it's full.
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
+
+	// Sum up the shards' counts, each read under its shard's lock.
+	size_t GetUsedMemory() const final;
+	size_t GetNumAllocations() const final;
+
+	unsigned GetNumShards() const { return m_NumShards; }
+	FreeListAllocator& GetShard(unsigned index) const;
+	alloc::LockStats GetShardStats(unsigned index) const;
+};
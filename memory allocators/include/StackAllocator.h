@@ -4,11 +4,15 @@
 
 // The pointer is moved by requested amount of bytes and aligned to store the address and header.
 // Also holds the last allocation for debugging purposes, which is disabled in Release builds.
+// With alloc::Backing::Virtual only address space is reserved, pages are committed as the stack grows.
+//
+// With alloc::Frees::Sized allocations are rounded to 2 pointers and the top stays aligned to that,
+// so only allocations with a bigger alignment need a header.
 class StackAllocator : public Allocator
 {
 	StackAllocator(StackAllocator const&);
 public:
-	StackAllocator(size_t size);
+	StackAllocator(size_t size, alloc::Source const &source = alloc::Source(), alloc::Frees frees = alloc::Frees::Unsized);
 	~StackAllocator();
 private:
 	struct Header
@@ -16,6 +20,7 @@ private:
 		#if _DEBUG
 		void *prev_address;
 		#endif
+		// Encoded, see alloc::math::StoreAdjustment().
 		uint8_t adjustment;
 	};
 #if _DEBUG
@@ -23,7 +28,13 @@ private:
 	void *m_PreviousPosition;
 #endif
 	void *m_CurrentPosition;
+	alloc::Frees m_Frees;
 public:
-	void* Allocate(size_t size, uint8_t alignment) override;
-	void Deallocate(void *addresss) override;
+	void* Allocate(size_t size, size_t alignment) final;
+	void Deallocate(void *addresss) final;
+	void Deallocate(void *address, size_t size, size_t alignment) final;
+	alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) final;
+	// Resizes the top allocation in place. Others can only shrink, and only with alloc::Frees::Unsized.
+	void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) final;
+	bool Owns(void *address) const final { return Allocator::Owns(address); }
 };
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Allocator.h"
+#include "PoolAllocator.h"
+
+#include <map>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace alloc
+{
+	// PoolAllocators per node size, for StlAllocator.
+	// Each size gets pools of (@param chunk_size) bytes carved from (@param parent), adding one whenever the others are full.
+	// A size takes no memory until its first allocation.
+	// Must outlive the containers using it, and like the allocators it isn't thread safe.
+	class NodePools
+	{
+		NodePools(NodePools const&);
+	public:
+		NodePools(Allocator &parent, size_t chunk_size = 65536);
+		~NodePools();
+
+		// All objects of one size and alignment.
+		class Pool
+		{
+			Pool(Pool const&);
+		public:
+			Pool(Allocator &parent, size_t obj_size, size_t obj_alignment, size_t chunk_size);
+		private:
+			Allocator &m_Parent;
+			size_t m_ObjectSize;
+			size_t m_ObjectAlignment;
+			size_t m_ChunkSize;
+			std::vector<std::unique_ptr<PoolAllocator>> m_Chunks;
+			// Chunk the last allocation came from, tried first.
+			PoolAllocator *m_Current;
+		public:
+			// Returns nullptr if every chunk is full and the parent can't fit another.
+			void* Allocate();
+			void Deallocate(void *address);
+			bool Owns(void *address) const;
+
+			size_t GetObjectSize() const { return m_ObjectSize; }
+			size_t GetNumChunks() const { return m_Chunks.size(); }
+		};
+	private:
+		Allocator &m_Parent;
+		size_t m_ChunkSize;
+		// Keyed by object size and alignment, map nodes keep the references stable.
+		std::map<std::pair<size_t, size_t>, Pool> m_Pools;
+	public:
+		// Pool for objects of (@param size) and (@param alignment), created on first use.
+		Pool& GetPool(size_t size, size_t alignment);
+		size_t GetNumPools() const { return m_Pools.size(); }
+	};
+
+	// Standard allocator over an Allocator, for code using std containers with custom allocators.
+	// With NodePools, the allocators a container rebinds to its node type, i.e. for std::map, std::list or std::unordered_map,
+	// take single objects from a pool for that type. The allocator the container was given, for its value_type,
+	// never uses the pools, so a std::vector or std::string of one element doesn't end up in one. Arrays always come from the Allocator.
+	// Out of memory throws std::bad_alloc.
+	template<class T>
+	class StlAllocator
+	{
+		template<class U> friend class StlAllocator;
+	public:
+		typedef T value_type;
+
+		StlAllocator(Allocator &alloc, NodePools *pools = nullptr) :
+			m_Allocator(&alloc),
+			m_Pools(pools),
+			m_Pool(nullptr)
+		{
+		}
+
+		// Rebinding picks the pool for the new type, containers rebind for their nodes. Copies keep the pool they had.
+		template<class U>
+		StlAllocator(StlAllocator<U> const &other) :
+			m_Allocator(other.m_Allocator),
+			m_Pools(other.m_Pools),
+			m_Pool(other.m_Pools ? &other.m_Pools->GetPool(sizeof(T), alignof(T)) : nullptr)
+		{
+		}
+	private:
+		Allocator *m_Allocator;
+		NodePools *m_Pools;
+		NodePools::Pool *m_Pool;
+	public:
+		T* allocate(size_t n)
+		{
+			void *address = nullptr;
+
+			if (m_Pool && n == 1)
+			{
+				address = m_Pool->Allocate();
+			}
+
+			if (!address)
+			{
+				address = m_Allocator->Allocate(sizeof(T) * n, alignof(T));
+			}
+
+			if (!address)
+			{
+				throw std::bad_alloc();
+			}
+
+			return static_cast<T*>(address);
+		}
+
+		void deallocate(T *address, size_t n)
+		{
+			// Nodes only end up outside the pool when the parent was full.
+			if (m_Pool && n == 1 && m_Pool->Owns(address))
+			{
+				m_Pool->Deallocate(address);
+			}
+			else
+			{
+				m_Allocator->Deallocate(address, sizeof(T) * n, alignof(T));
+			}
+		}
+
+		template<class U>
+		bool operator==(StlAllocator<U> const &other) const { return m_Allocator == other.m_Allocator && m_Pools == other.m_Pools; }
+		template<class U>
+		bool operator!=(StlAllocator<U> const &other) const { return !(*this == other); }
+	};
+}
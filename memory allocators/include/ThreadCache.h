@@ -0,0 +1,321 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace alloc
+{
+	namespace detail
+	{
+		// Guards the thread lists of every ThreadCache, taken when a thread first uses one, at thread exit and on destruction.
+		inline std::mutex& ThreadCacheRegistry()
+		{
+			static std::mutex s_Registry;
+			return s_Registry;
+		}
+	}
+
+	// Thread-local cache in front of a shared FreeListAllocator, like glibc's tcache.
+	// Every thread gets a bounded LIFO bin per size class of kGranule up to kMaxCachedSize, so repeated requests
+	// for the same sizes are a pop and a push, without the lock, the free list walk, splitting or coalescing.
+	// An empty bin is refilled with half its capacity in one locked visit to the allocator,
+	// a full one gives back its older half the same way. Bigger or over-aligned requests go to the allocator under Lock.
+	//
+	// Unsized Deallocate reads the block size from A::GetAllocationSize(), so with alloc::Frees::Sized frees must be sized.
+	// A thread's bins go back to the allocator when it exits, or when the cache is destroyed, whichever comes first.
+	// Cached blocks are still allocated as far as A knows, so A must outlive the cache, and the bins make its statistics run high.
+	template<class A, class Lock = std::mutex>
+	class ThreadCache
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		ThreadCache(ThreadCache const&);
+	public:
+		ThreadCache(A &alloc, unsigned bin_capacity = 32) :
+			m_Allocator(alloc),
+			m_BinCapacity(bin_capacity)
+		{
+			assert(m_BinCapacity >= 2);
+		}
+
+		~ThreadCache()
+		{
+			std::lock_guard<std::mutex> registry(detail::ThreadCacheRegistry());
+
+			for (Bins *bins : m_Threads)
+			{
+				Flush(*bins);
+				bins->owner.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+	private:
+		static const size_t kGranule = 16;
+		static const size_t kMaxCachedSize = 512;
+		// Class c holds blocks of at least c * kGranule bytes, class 0 is unused.
+		static const unsigned kNumClasses = kMaxCachedSize / kGranule + 1;
+
+		// One thread's bins for one cache.
+		struct Bins
+		{
+			Bins(ThreadCache *cache) :
+				owner(cache),
+				objects(new void*[kNumClasses * cache->m_BinCapacity])
+			{
+				for (unsigned i = 0; i < kNumClasses; i++)
+				{
+					counts[i] = 0;
+				}
+			}
+
+			// Cleared when the cache goes first, other threads may read it while looking up theirs.
+			std::atomic<ThreadCache*> owner;
+			std::unique_ptr<void*[]> objects;
+			unsigned counts[kNumClasses];
+		};
+
+		// Every cache's bins of a thread, given back at thread exit.
+		struct ThreadBins
+		{
+			~ThreadBins()
+			{
+				std::lock_guard<std::mutex> registry(detail::ThreadCacheRegistry());
+
+				for (Bins *bins : list)
+				{
+					if (ThreadCache *cache = bins->owner.load(std::memory_order_relaxed))
+					{
+						cache->Flush(*bins);
+						cache->m_Threads.erase(std::find(cache->m_Threads.begin(), cache->m_Threads.end(), bins));
+					}
+
+					delete bins;
+				}
+			}
+
+			std::vector<Bins*> list;
+		};
+
+		A &m_Allocator;
+		Lock m_Lock;
+		unsigned m_BinCapacity;
+		// Bins of the threads that used it, under the registry lock.
+		std::vector<Bins*> m_Threads;
+
+		static unsigned ClassFromSize(size_t size)
+		{
+			return static_cast<unsigned>((size + kGranule - 1) / kGranule);
+		}
+
+		Bins& BinsForThread()
+		{
+			thread_local ThreadBins t_Bins;
+
+			for (Bins *bins : t_Bins.list)
+			{
+				if (bins->owner.load(std::memory_order_relaxed) == this)
+				{
+					return *bins;
+				}
+			}
+
+			// Drop the bins of caches destroyed meanwhile, they've been flushed already.
+			for (size_t i = t_Bins.list.size(); i > 0; i--)
+			{
+				if (!t_Bins.list[i - 1]->owner.load(std::memory_order_relaxed))
+				{
+					delete t_Bins.list[i - 1];
+					t_Bins.list.erase(t_Bins.list.begin() + (i - 1));
+				}
+			}
+
+			Bins *bins = new Bins(this);
+			{
+				std::lock_guard<std::mutex> registry(detail::ThreadCacheRegistry());
+				m_Threads.push_back(bins);
+			}
+
+			t_Bins.list.push_back(bins);
+
+			return *bins;
+		}
+
+		void** Bin(Bins &bins, unsigned size_class)
+		{
+			return &bins.objects[size_class * m_BinCapacity];
+		}
+
+		void Refill(Bins &bins, unsigned size_class)
+		{
+			void **bin = Bin(bins, size_class);
+			unsigned &count = bins.counts[size_class];
+
+			std::lock_guard<Lock> guard(m_Lock);
+
+			while (count < m_BinCapacity / 2)
+			{
+				void *address = m_Allocator.Allocate(size_class * kGranule, kGranule);
+
+				if (!address)
+				{
+					break;
+				}
+
+				bin[count++] = address;
+			}
+		}
+
+		// The oldest (@param num_objects), the recently freed ones are likelier in cache.
+		void Release(Bins &bins, unsigned size_class, unsigned num_objects)
+		{
+			void **bin = Bin(bins, size_class);
+			unsigned &count = bins.counts[size_class];
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+
+				for (unsigned i = 0; i < num_objects; i++)
+				{
+					DeallocateSized(m_Allocator, bin[i], size_class * kGranule, kGranule);
+				}
+			}
+
+			count -= num_objects;
+
+			for (unsigned i = 0; i < count; i++)
+			{
+				bin[i] = bin[i + num_objects];
+			}
+		}
+
+		void Flush(Bins &bins)
+		{
+			for (unsigned size_class = 1; size_class < kNumClasses; size_class++)
+			{
+				if (bins.counts[size_class])
+				{
+					Release(bins, size_class, bins.counts[size_class]);
+				}
+			}
+		}
+
+		void Push(unsigned size_class, void *address)
+		{
+			Bins &bins = BinsForThread();
+			unsigned &count = bins.counts[size_class];
+
+			if (count == m_BinCapacity)
+			{
+				Release(bins, size_class, m_BinCapacity / 2);
+			}
+
+			Bin(bins, size_class)[count++] = address;
+		}
+	public:
+		void* Allocate(size_t size, size_t alignment = 4)
+		{
+			assert(size != 0 && alignment != 0);
+
+			if (size > kMaxCachedSize || alignment > kGranule)
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+				return m_Allocator.Allocate(size, alignment);
+			}
+
+			const unsigned size_class = ClassFromSize(size);
+			Bins &bins = BinsForThread();
+			unsigned &count = bins.counts[size_class];
+
+			if (count == 0)
+			{
+				Refill(bins, size_class);
+			}
+
+			return count ? Bin(bins, size_class)[--count] : nullptr;
+		}
+
+		void Deallocate(void *address)
+		{
+			if (!address)
+			{
+				return;
+			}
+
+			// Reads the block's own header, not the free list.
+			const size_t size = m_Allocator.GetAllocationSize(address);
+
+			// Refilled blocks may have a little more than their class, anything well above or below came from the allocator.
+			if (size < kGranule || size >= kMaxCachedSize + 2 * kGranule)
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+				m_Allocator.Deallocate(address);
+				return;
+			}
+
+			const unsigned size_class = static_cast<unsigned>(size / kGranule);
+
+			Push(size_class < kNumClasses ? size_class : kNumClasses - 1, address);
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment)
+		{
+			if (!address)
+			{
+				return;
+			}
+
+			if (size > kMaxCachedSize || alignment > kGranule)
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+				DeallocateSized(m_Allocator, address, size, alignment);
+				return;
+			}
+
+			Push(ClassFromSize(size), address);
+		}
+
+		Allocation AllocateAtLeast(size_t size, size_t alignment)
+		{
+			if (size > kMaxCachedSize || alignment > kGranule)
+			{
+				std::lock_guard<Lock> guard(m_Lock);
+				return alloc::AllocateAtLeast(m_Allocator, size, alignment);
+			}
+
+			void *address = Allocate(size, alignment);
+
+			return{ address, address ? ClassFromSize(size) * kGranule : 0 };
+		}
+
+		bool Owns(void *address) const
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		// Gives the calling thread's bins back to the allocator.
+		void Flush()
+		{
+			Flush(BinsForThread());
+		}
+
+		// Blocks in the calling thread's bins.
+		size_t GetCachedObjects()
+		{
+			Bins &bins = BinsForThread();
+			size_t count = 0;
+
+			for (unsigned i = 0; i < kNumClasses; i++)
+			{
+				count += bins.counts[i];
+			}
+
+			return count;
+		}
+
+		unsigned GetBinCapacity() const { return m_BinCapacity; }
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Allocator.h"
+
+namespace alloc
+{
+	// Thin adapter giving any type satisfying IsAllocator the virtual Allocator interface.
+	// For the places that need type erasure, everything else should use the concrete type.
+	template<class A>
+	class VirtualAllocator final : public Allocator
+	{
+		static_assert(IsAllocator<A>::value, "A doesn't satisfy the allocator concept");
+
+		VirtualAllocator(VirtualAllocator const&);
+	public:
+		VirtualAllocator(A &alloc) :
+			m_Allocator(alloc)
+		{
+		}
+
+		~VirtualAllocator()
+		{
+			assert(m_Allocations == 0);
+		}
+	private:
+		A &m_Allocator;
+	public:
+		void* Allocate(size_t size, size_t alignment) override
+		{
+			void *address = m_Allocator.Allocate(size, alignment);
+
+			if (address)
+			{
+				m_Allocations++;
+			}
+
+			return address;
+		}
+
+		alloc::Allocation AllocateAtLeast(size_t size, size_t alignment) override
+		{
+			const Allocation allocation = alloc::AllocateAtLeast(m_Allocator, size, alignment);
+
+			if (allocation.pointer)
+			{
+				m_Allocations++;
+			}
+
+			return allocation;
+		}
+
+		void* Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment) override
+		{
+			void *const new_address = alloc::Reallocate(m_Allocator, address, old_size, new_size, alignment);
+
+			// Only counts when there was nothing to resize.
+			if (new_address && !address)
+			{
+				m_Allocations++;
+			}
+
+			return new_address;
+		}
+
+		void Deallocate(void *address) override
+		{
+			m_Allocations--;
+
+			m_Allocator.Deallocate(address);
+		}
+
+		void Deallocate(void *address, size_t size, size_t alignment) override
+		{
+			m_Allocations--;
+
+			DeallocateSized(m_Allocator, address, size, alignment);
+		}
+
+		bool Owns(void *address) const override
+		{
+			return alloc::Owns(m_Allocator, address);
+		}
+
+		A& GetAllocator() const { return m_Allocator; }
+	};
+}
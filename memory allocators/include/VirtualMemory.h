@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Thin layer over the virtual memory calls of the OS.
+// Addresses and sizes passed in must be multiples of PageSize().
+namespace alloc { namespace vm
+{
+	// Page sizes memory can end up mapped with.
+	enum class PageMode : uint8_t
+	{
+		// Regular pages, usually 4KB.
+		Small,
+		// Explicit huge pages, MAP_HUGETLB on Linux or large pages on Windows.
+		Huge,
+		// 2MB-aligned mapping, with transparent huge pages requested through madvise.
+		Transparent
+	};
+
+	const size_t kHugePageSize = 2 * 1024 * 1024;
+
+	// Which NUMA nodes the pages of a range are placed on.
+	enum class Numa : uint8_t
+	{
+		// Whatever the OS does by default.
+		Default,
+		// Only on the given node.
+		Bind,
+		// Spread round-robin over all nodes.
+		Interleave,
+		// On the node of the thread that touches a page first, see Prefault().
+		FirstTouch
+	};
+
+	// Size of a page, the granularity of Commit() and Decommit().
+	size_t PageSize();
+
+	// Reserve address space without backing it with memory.
+	// Returns nullptr on failure.
+	void* Reserve(size_t size);
+
+	// Back [address, address + size) with readable and writable memory.
+	bool Commit(void *address, size_t size);
+
+	// Give the pages back to the OS, the range stays reserved.
+	void Decommit(void *address, size_t size);
+
+	// Release a range returned by Reserve().
+	void Release(void *address, size_t size);
+
+	// Map committed memory on huge pages where possible, to cut down on TLB misses.
+	// Tries explicit huge pages first, then falls back to a 2MB-aligned mapping advised for transparent huge pages.
+	// (@param mode) is set to what actually took effect.
+	void* MapHuge(size_t size, PageMode &mode);
+
+	// Release a range returned by MapHuge().
+	void UnmapHuge(void *address, size_t size);
+
+	// Whether memory advised for transparent huge pages gets them, i.e. the kernel setting is "always" or "madvise".
+	bool TransparentHugePagesEnabled();
+
+	// Number of NUMA nodes, 1 on single node machines or when unknown.
+	unsigned NumaNodeCount();
+
+	// NUMA node the calling thread runs on, 0 when unknown.
+	unsigned CurrentNumaNode();
+
+	// CPU the calling thread runs on, 0 when unknown. The thread may have moved by the time it returns.
+	unsigned CurrentCpu();
+	// Whether CurrentCpu() reports real CPU numbers here.
+	bool CurrentCpuSupported();
+
+	// Apply (@param policy) to pages that aren't touched yet.
+	// Does nothing on single node machines, returns false if the OS refused.
+	bool Place(void *address, size_t size, Numa policy, unsigned node);
+
+	// Touch every page of the range from the calling thread, keeping its contents.
+	void Prefault(void *address, size_t size);
+}}
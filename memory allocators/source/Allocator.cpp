@@ -0,0 +1,167 @@
+#include "Allocator.h"
+
+namespace
+{
+	// Commit at least this much at once, so a bump allocator doesn't call into the OS for every page.
+	const size_t kCommitGranularity = 65536;
+}
+
+Allocator::Allocator(size_t size, alloc::Source const &source) :
+	m_Size(size),
+	m_Start(nullptr),
+	m_UsedMemory(0),
+	m_Allocations(0),
+	m_Backing(source.backing),
+	m_Parent(source.parent),
+	m_ParentAlignment(source.alignment),
+	m_PageMode(alloc::vm::PageMode::Small),
+	m_Committed(nullptr)
+{
+	switch (m_Backing)
+	{
+	case alloc::Backing::Heap:
+		m_Start = malloc(size);
+		break;
+	case alloc::Backing::Virtual:
+		m_Start = alloc::vm::Reserve(size);
+		break;
+	case alloc::Backing::Mapped:
+		m_Start = alloc::vm::Reserve(size);
+
+		if (m_Start && !alloc::vm::Commit(m_Start, size))
+		{
+			alloc::vm::Release(m_Start, size);
+			m_Start = nullptr;
+		}
+		break;
+	case alloc::Backing::Buffer:
+		m_Start = source.buffer;
+		break;
+	case alloc::Backing::Parent:
+		assert(m_Parent);
+		m_Start = m_Parent->Allocate(size, source.alignment);
+		break;
+	case alloc::Backing::Huge:
+		m_Start = alloc::vm::MapHuge(size, m_PageMode);
+		break;
+	}
+
+	// Only memory mapped by us can be placed, before any of it is touched.
+	const bool mapped = m_Backing == alloc::Backing::Virtual || m_Backing == alloc::Backing::Mapped || m_Backing == alloc::Backing::Huge;
+
+	if (m_Start && mapped && source.numa != alloc::vm::Numa::Default)
+	{
+		alloc::vm::Place(m_Start, size, source.numa, source.node);
+	}
+
+	// Virtual memory is committed by CommitTo(), everything else is usable right away.
+	m_Committed = m_Backing == alloc::Backing::Virtual || !m_Start ? m_Start : alloc::math::Add(m_Start, size);
+}
+
+Allocator::~Allocator()
+{
+	switch (m_Backing)
+	{
+	case alloc::Backing::Heap:
+		free(m_Start);
+		break;
+	case alloc::Backing::Virtual:
+	case alloc::Backing::Mapped:
+		if (m_Start)
+		{
+			alloc::vm::Release(m_Start, m_Size);
+		}
+		break;
+	case alloc::Backing::Buffer:
+		break;
+	case alloc::Backing::Parent:
+		if (m_Start)
+		{
+			m_Parent->Deallocate(m_Start, m_Size, m_ParentAlignment);
+		}
+		break;
+	case alloc::Backing::Huge:
+		if (m_Start)
+		{
+			alloc::vm::UnmapHuge(m_Start, m_Size);
+		}
+		break;
+	}
+
+	m_Start = nullptr;
+	m_Committed = nullptr;
+	m_Size = 0;
+}
+
+void* Allocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	void *const new_address = Allocate(new_size, alignment);
+
+	if (new_address && address)
+	{
+		memcpy(new_address, address, old_size < new_size ? old_size : new_size);
+		Deallocate(address, old_size, alignment);
+	}
+
+	return new_address;
+}
+
+bool Allocator::CommitTo(void *end)
+{
+	assert(m_Backing == alloc::Backing::Virtual);
+
+	const uintptr_t start = reinterpret_cast<uintptr_t>(m_Start);
+	const uintptr_t committed = reinterpret_cast<uintptr_t>(m_Committed);
+	const size_t page_size = alloc::vm::PageSize();
+	const size_t granularity = page_size > kCommitGranularity ? page_size : kCommitGranularity;
+
+	// Memory beyond m_Size isn't ours, even if it lies on a reserved page.
+	if (reinterpret_cast<uintptr_t>(end) > start + m_Size)
+	{
+		return false;
+	}
+
+	uintptr_t commit_end = committed + granularity;
+
+	if (commit_end < reinterpret_cast<uintptr_t>(end))
+	{
+		commit_end = reinterpret_cast<uintptr_t>(end);
+	}
+
+	// Whole pages only, but never past the reservation.
+	const uintptr_t reserved_end = (start + m_Size + page_size - 1) & ~static_cast<uintptr_t>(page_size - 1);
+	commit_end = (commit_end + page_size - 1) & ~static_cast<uintptr_t>(page_size - 1);
+
+	if (commit_end > reserved_end)
+	{
+		commit_end = reserved_end;
+	}
+
+	if (!alloc::vm::Commit(m_Committed, commit_end - committed))
+	{
+		return false;
+	}
+
+	m_Committed = reinterpret_cast<void*>(commit_end);
+
+	return true;
+}
+
+void Allocator::DecommitFrom(void *start)
+{
+	assert(m_Backing == alloc::Backing::Virtual);
+
+	const size_t page_size = alloc::vm::PageSize();
+	const uintptr_t committed = reinterpret_cast<uintptr_t>(m_Committed);
+	const uintptr_t decommit_start = (reinterpret_cast<uintptr_t>(start) + page_size - 1) & ~static_cast<uintptr_t>(page_size - 1);
+
+	// Not worth a system call, it would be committed again on the next bump.
+	if (decommit_start >= committed || committed - decommit_start < kCommitGranularity)
+	{
+		return;
+	}
+
+	alloc::vm::Decommit(reinterpret_cast<void*>(decommit_start), committed - decommit_start);
+
+	m_Committed = reinterpret_cast<void*>(decommit_start);
+}
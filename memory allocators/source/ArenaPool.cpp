@@ -0,0 +1,125 @@
+#include "ArenaPool.h"
+
+ArenaPool::ArenaPool(size_t max_idle_trims, alloc::Backing backing) :
+	m_Trims(0),
+	m_MaxIdleTrims(max_idle_trims),
+	m_Backing(backing)
+{
+}
+
+ArenaPool::~ArenaPool()
+{
+	for (std::vector<IdleArena> &free_list : m_FreeLists)
+	{
+		for (IdleArena &idle : free_list)
+		{
+			delete idle.arena;
+		}
+	}
+}
+
+unsigned ArenaPool::ClassFromSize(size_t size)
+{
+	unsigned size_class = 0;
+	size_t class_size = kMinArenaSize;
+
+	while (class_size < size)
+	{
+		class_size *= 4;
+		size_class++;
+	}
+
+	return size_class;
+}
+
+LinearAllocator* ArenaPool::Acquire(size_t size)
+{
+	assert(size > 0);
+
+	const unsigned size_class = ClassFromSize(size);
+
+	// Too big to pool, sized exactly.
+	if (size_class >= kNumClasses)
+	{
+		return new LinearAllocator(size, m_Backing);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::vector<IdleArena> &free_list = m_FreeLists[size_class];
+
+		if (!free_list.empty())
+		{
+			LinearAllocator *const arena = free_list.back().arena;
+			free_list.pop_back();
+
+			return arena;
+		}
+	}
+
+	// Allocate outside the lock, this is the slow path the pool exists to avoid.
+	return new LinearAllocator(kMinArenaSize << (2 * size_class), m_Backing);
+}
+
+void ArenaPool::Release(LinearAllocator *arena)
+{
+	assert(arena);
+
+	arena->Clear();
+
+	const unsigned size_class = ClassFromSize(arena->GetSize());
+
+	if (size_class >= kNumClasses)
+	{
+		delete arena;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_FreeLists[size_class].push_back({ arena, m_Trims });
+}
+
+void ArenaPool::Trim()
+{
+	std::vector<LinearAllocator*> expired;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_Trims++;
+
+		for (std::vector<IdleArena> &free_list : m_FreeLists)
+		{
+			// Oldest arenas are at the front.
+			size_t count = 0;
+
+			while (count < free_list.size() && m_Trims - free_list[count].released_at > m_MaxIdleTrims)
+			{
+				expired.push_back(free_list[count].arena);
+				count++;
+			}
+
+			free_list.erase(free_list.begin(), free_list.begin() + count);
+		}
+	}
+
+	for (LinearAllocator *arena : expired)
+	{
+		delete arena;
+	}
+}
+
+size_t ArenaPool::GetNumIdleArenas() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	size_t count = 0;
+
+	for (std::vector<IdleArena> const &free_list : m_FreeLists)
+	{
+		count += free_list.size();
+	}
+
+	return count;
+}
@@ -0,0 +1,294 @@
+#include "ConcurrentFreeListAllocator.h"
+
+using alloc::math::AdjustmentFromAlign;
+using alloc::math::Add;
+using alloc::math::Subtract;
+
+namespace
+{
+	// Round (@param size) up to a multiple of (@param granule), which must be a power of 2.
+	inline size_t RoundUp(size_t size, size_t granule)
+	{
+		return (size + granule - 1) & ~(granule - 1);
+	}
+}
+
+ConcurrentFreeListAllocator::ConcurrentFreeListAllocator(size_t size, alloc::Source const &source) :
+	Allocator(size, source),
+	m_Used(0),
+	m_Count(0),
+	m_Consolidations(0)
+{
+	// Blocks are split anywhere in the memory, so it has to be committed upfront.
+	assert(source.backing != alloc::Backing::Virtual);
+
+	const size_t adjustment = AdjustmentFromAlign(m_Start, kGranule);
+
+	assert(size >= adjustment + kMinBlockSize);
+
+	m_FirstBlock = reinterpret_cast<Block*>(Add(m_Start, adjustment));
+	m_End = reinterpret_cast<uintptr_t>(m_FirstBlock) + ((size - adjustment) & ~kFlags);
+
+	List(m_FirstBlock, m_End - reinterpret_cast<uintptr_t>(m_FirstBlock));
+}
+
+ConcurrentFreeListAllocator::~ConcurrentFreeListAllocator()
+{
+	assert(m_Count.load(std::memory_order_relaxed) == 0 && m_Used.load(std::memory_order_relaxed) == 0);
+}
+
+unsigned ConcurrentFreeListAllocator::BinFromSize(size_t size)
+{
+	if (size < kSmallLimit)
+	{
+		return static_cast<unsigned>(size / kGranule);
+	}
+
+	unsigned bin = 64;
+
+	for (size_t limit = kSmallLimit << 1; size >= limit && bin < kNumBins - 1; limit <<= 1)
+	{
+		bin++;
+	}
+
+	return bin;
+}
+
+void ConcurrentFreeListAllocator::List(Block *block, size_t size)
+{
+	Bin &bin = m_Bins[BinFromSize(size)];
+	std::lock_guard<std::mutex> guard(bin.lock);
+
+	block->next = bin.head.load(std::memory_order_relaxed);
+	block->size_and_flags = size | kFree;
+	bin.head.store(block, std::memory_order_relaxed);
+}
+
+ConcurrentFreeListAllocator::Block* ConcurrentFreeListAllocator::TakeFrom(unsigned index, size_t size)
+{
+	Bin &bin = m_Bins[index];
+	Block *rest = nullptr;
+	size_t rest_size = 0;
+	Block *block;
+	{
+		std::lock_guard<std::mutex> guard(bin.lock);
+
+		Block *prev_block = nullptr;
+		block = bin.head.load(std::memory_order_relaxed);
+
+		// First fit, only the smallest bin tried can have blocks that are too small, and only above kSmallLimit.
+		while (block && SizeOf(block) < size)
+		{
+			prev_block = block;
+			block = block->next;
+		}
+
+		if (!block)
+		{
+			return nullptr;
+		}
+
+		if (prev_block)
+		{
+			prev_block->next = block->next;
+		}
+		else
+		{
+			bin.head.store(block->next, std::memory_order_relaxed);
+		}
+
+		const size_t block_size = SizeOf(block);
+
+		// Split off the rest if it can be a block, it's listed once the bin lock is released.
+		if (block_size - size >= kMinBlockSize)
+		{
+			rest = reinterpret_cast<Block*>(Add(block, size));
+			rest_size = block_size - size;
+			rest->size_and_flags = rest_size;
+			block->size_and_flags = size;
+		}
+		else
+		{
+			block->size_and_flags = block_size;
+		}
+	}
+
+	// Taking another bin's lock while holding this one could deadlock with Consolidate().
+	if (rest)
+	{
+		List(rest, rest_size);
+	}
+
+	return block;
+}
+
+ConcurrentFreeListAllocator::Block* ConcurrentFreeListAllocator::BlockFromAddress(void *address) const
+{
+	const size_t word = *reinterpret_cast<size_t*>(Subtract(address, sizeof(size_t)));
+
+	if (word & kOffset)
+	{
+		return reinterpret_cast<Block*>(Subtract(address, word & ~kFlags));
+	}
+
+	return reinterpret_cast<Block*>(Subtract(address, sizeof(Block)));
+}
+
+void* ConcurrentFreeListAllocator::Allocate(size_t size, size_t alignment)
+{
+	return ConcurrentFreeListAllocator::AllocateAtLeast(size, alignment).pointer;
+}
+
+alloc::Allocation ConcurrentFreeListAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	assert(size != 0 && alignment != 0);
+
+	// Memory starts kGranule aligned after the header, bigger alignments may need to skip up to (alignment - kGranule).
+	size_t block_size = RoundUp(sizeof(Block) + size, kGranule);
+
+	if (alignment > kGranule)
+	{
+		block_size += alignment - kGranule;
+	}
+
+	if (block_size < kMinBlockSize)
+	{
+		block_size = kMinBlockSize;
+	}
+
+	Block *block = nullptr;
+
+	for (unsigned attempt = 0; attempt < 2 && !block; attempt++)
+	{
+		// Nothing free is big enough until adjacent blocks are merged.
+		if (attempt == 1 && Consolidate() < block_size)
+		{
+			return{ nullptr, 0 };
+		}
+
+		for (unsigned bin = BinFromSize(block_size); bin < kNumBins && !block; bin++)
+		{
+			// May be stale, a block listed meanwhile is found next time, or by the retry after Consolidate().
+			if (m_Bins[bin].head.load(std::memory_order_relaxed))
+			{
+				block = TakeFrom(bin, block_size);
+			}
+		}
+	}
+
+	if (!block)
+	{
+		return{ nullptr, 0 };
+	}
+
+	void *address = Add(block, sizeof(Block));
+	const size_t adjustment = AdjustmentFromAlign(address, alignment);
+
+	if (adjustment > 0)
+	{
+		address = Add(address, adjustment);
+		*reinterpret_cast<size_t*>(Subtract(address, sizeof(size_t))) = (sizeof(Block) + adjustment) | kOffset;
+	}
+
+	m_Used.fetch_add(SizeOf(block), std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+
+	return{ address, SizeOf(block) - sizeof(Block) - adjustment };
+}
+
+void ConcurrentFreeListAllocator::Deallocate(void *address)
+{
+	assert(address);
+
+	Block *block = BlockFromAddress(address);
+	const size_t block_size = SizeOf(block);
+
+	assert((block->size_and_flags & kFree) == 0 && "Block is already free");
+
+	m_Used.fetch_sub(block_size, std::memory_order_relaxed);
+	m_Count.fetch_sub(1, std::memory_order_relaxed);
+
+	List(block, block_size);
+}
+
+size_t ConcurrentFreeListAllocator::Consolidate()
+{
+	for (unsigned i = 0; i < kNumBins; i++)
+	{
+		m_Bins[i].lock.lock();
+	}
+
+	// Rebuilt in address order, so first fit favours low addresses.
+	Block *tails[kNumBins];
+
+	for (unsigned i = 0; i < kNumBins; i++)
+	{
+		m_Bins[i].head.store(nullptr, std::memory_order_relaxed);
+		tails[i] = nullptr;
+	}
+
+	size_t largest = 0;
+	Block *block = m_FirstBlock;
+
+	while (reinterpret_cast<uintptr_t>(block) < m_End)
+	{
+		size_t block_size = SizeOf(block);
+		Block *next_block = reinterpret_cast<Block*>(Add(block, block_size));
+
+		if ((block->size_and_flags & kFree) == 0)
+		{
+			block = next_block;
+			continue;
+		}
+
+		// Swallow the free blocks that follow.
+		while (reinterpret_cast<uintptr_t>(next_block) < m_End && (next_block->size_and_flags & kFree))
+		{
+			block_size += SizeOf(next_block);
+			next_block = reinterpret_cast<Block*>(Add(block, block_size));
+		}
+
+		const unsigned index = BinFromSize(block_size);
+
+		block->size_and_flags = block_size | kFree;
+		block->next = nullptr;
+
+		if (tails[index])
+		{
+			tails[index]->next = block;
+		}
+		else
+		{
+			m_Bins[index].head.store(block, std::memory_order_relaxed);
+		}
+
+		tails[index] = block;
+		largest = block_size > largest ? block_size : largest;
+
+		block = next_block;
+	}
+
+	m_Consolidations.fetch_add(1, std::memory_order_relaxed);
+
+	for (unsigned i = kNumBins; i > 0; i--)
+	{
+		m_Bins[i - 1].lock.unlock();
+	}
+
+	return largest;
+}
+
+size_t ConcurrentFreeListAllocator::GetUsedMemory() const
+{
+	return m_Used.load(std::memory_order_relaxed);
+}
+
+size_t ConcurrentFreeListAllocator::GetNumAllocations() const
+{
+	return m_Count.load(std::memory_order_relaxed);
+}
+
+size_t ConcurrentFreeListAllocator::GetNumConsolidations() const
+{
+	return m_Consolidations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,123 @@
+#include "ConcurrentLinearAllocator.h"
+
+using alloc::math::AdjustmentFromAlign;
+using alloc::math::Add;
+
+ConcurrentLinearAllocator::ConcurrentLinearAllocator(size_t size, alloc::Source const &source) :
+	Allocator(size, source),
+	m_Offset(0)
+{
+	assert(size > 0);
+	// Committing would need a lock, so the memory has to be usable upfront.
+	assert(source.backing != alloc::Backing::Virtual);
+}
+
+ConcurrentLinearAllocator::~ConcurrentLinearAllocator()
+{
+	assert(m_Offset.load(std::memory_order_relaxed) == 0);
+}
+
+void* ConcurrentLinearAllocator::Allocate(size_t size, size_t alignment)
+{
+	return ConcurrentLinearAllocator::AllocateAtLeast(size, alignment).pointer;
+}
+
+alloc::Allocation ConcurrentLinearAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	assert(size != 0 && alignment != 0);
+
+	size_t offset = m_Offset.load(std::memory_order_relaxed);
+	void *position;
+	size_t adjustment;
+	size_t end;
+
+	// Only advances once the allocation is known to fit, so a failed request leaves room for smaller ones.
+	do
+	{
+		position = Add(m_Start, offset);
+		adjustment = AdjustmentFromAlign(position, alignment);
+
+		// Compared before adding, a request near SIZE_MAX mustn't wrap around.
+		if (offset + adjustment > m_Size || size > m_Size - offset - adjustment)
+		{
+			return{ nullptr, 0 };
+		}
+
+		end = offset + adjustment + size;
+	} while (!m_Offset.compare_exchange_weak(offset, end, std::memory_order_relaxed));
+
+	return{ Add(position, adjustment), size };
+}
+
+void ConcurrentLinearAllocator::Deallocate(void *address_not_used)
+{
+	return void();
+}
+
+void ConcurrentLinearAllocator::Deallocate(void *address_not_used, size_t size_not_used, size_t alignment_not_used)
+{
+	return void();
+}
+
+void ConcurrentLinearAllocator::Clear()
+{
+	m_Allocations = 0;
+	m_UsedMemory = 0;
+	m_Offset.store(0, std::memory_order_relaxed);
+}
+
+size_t ConcurrentLinearAllocator::GetUsedMemory() const
+{
+	return m_Offset.load(std::memory_order_relaxed);
+}
+
+ConcurrentLinearAllocator::Lease::Lease(ConcurrentLinearAllocator &arena, size_t block_size) :
+	m_Arena(arena),
+	m_BlockSize(block_size),
+	m_CurrentPosition(nullptr),
+	m_End(nullptr)
+{
+	assert(block_size > 0);
+}
+
+ConcurrentLinearAllocator::Lease::~Lease()
+{
+	// The rest of the block is simply wasted, it's returned with the arena on Clear().
+	m_CurrentPosition = nullptr;
+	m_End = nullptr;
+}
+
+void* ConcurrentLinearAllocator::Lease::Allocate(size_t size, size_t alignment)
+{
+	assert(size != 0 && alignment != 0);
+
+	size_t adjustment = AdjustmentFromAlign(m_CurrentPosition, alignment);
+
+	// Fast path, the block still has room.
+	if (m_CurrentPosition && reinterpret_cast<uintptr_t>(m_End) - reinterpret_cast<uintptr_t>(m_CurrentPosition) >= size + adjustment)
+	{
+		void *const aligned_address = Add(m_CurrentPosition, adjustment);
+		m_CurrentPosition = Add(aligned_address, size);
+
+		return aligned_address;
+	}
+
+	// Big allocations would waste most of a block, take them from the arena directly.
+	if (size > m_BlockSize / 4)
+	{
+		return m_Arena.Allocate(size, alignment);
+	}
+
+	void *const block = m_Arena.Allocate(m_BlockSize, alignment);
+
+	// Arena can't fit a whole block anymore, the remainder may still fit this allocation.
+	if (!block)
+	{
+		return m_Arena.Allocate(size, alignment);
+	}
+
+	m_CurrentPosition = Add(block, size);
+	m_End = Add(block, m_BlockSize);
+
+	return block;
+}
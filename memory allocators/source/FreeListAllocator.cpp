@@ -4,15 +4,39 @@ using alloc::math::AdjustmentFromAlign;
 using alloc::math::AdjustmentFromAlignWithHeader;
 using alloc::math::Add;
 using alloc::math::Subtract;
+using alloc::math::StoreAdjustment;
+using alloc::math::LoadAdjustment;
 
-FreeListAllocator::FreeListAllocator(size_t size) :
-	Allocator(size),
-	m_FreeBlock(reinterpret_cast<FreeBlock*>(m_Start))
+namespace
 {
-	assert(size > sizeof FreeBlock);
+	// Round (@param size) up to a multiple of (@param granule), which must be a power of 2.
+	inline size_t RoundUp(size_t size, size_t granule)
+	{
+		return (size + granule - 1) & ~(granule - 1);
+	}
+}
+
+FreeListAllocator::FreeListAllocator(size_t size, alloc::Source const &source, alloc::Frees frees) :
+	Allocator(size, source),
+	m_FreeBlock(reinterpret_cast<FreeBlock*>(m_Start)),
+	m_Frees(frees)
+{
+	assert(size > sizeof(FreeBlock));
+	// Blocks are split anywhere in the memory, so it has to be committed upfront.
+	assert(source.backing != alloc::Backing::Virtual);
 
 	m_FreeBlock->size = size;
 	m_FreeBlock->next = nullptr;
+
+	// Sized blocks start and end on multiples of sizeof FreeBlock, trim what doesn't fit.
+	if (frees == alloc::Frees::Sized)
+	{
+		const size_t adjustment = AdjustmentFromAlign(m_Start, sizeof(FreeBlock));
+
+		m_FreeBlock = reinterpret_cast<FreeBlock*>(Add(m_Start, adjustment));
+		m_FreeBlock->size = (size - adjustment) & ~(sizeof(FreeBlock) - 1);
+		m_FreeBlock->next = nullptr;
+	}
 }
 
 FreeListAllocator::~FreeListAllocator()
@@ -22,17 +46,22 @@ FreeListAllocator::~FreeListAllocator()
 	m_FreeBlock = nullptr;
 }
 
-void* FreeListAllocator::Allocate(size_t size, uint8_t alignment)
+void* FreeListAllocator::Allocate(size_t size, size_t alignment)
 {
 	assert(size != 0 && alignment != 0);
 
+	if (m_Frees == alloc::Frees::Sized)
+	{
+		return AllocateSized(size, alignment);
+	}
+
 	FreeBlock *prev_free_block = nullptr;
 	FreeBlock *free_block = m_FreeBlock; // Starting block atm.
 
 	while (free_block)
 	{
 		// Adjustment to keep object aligned.
-		const uint8_t adjustment = AdjustmentFromAlignWithHeader(free_block, alignment, sizeof Header);
+		const size_t adjustment = AdjustmentFromAlignWithHeader(free_block, alignment, sizeof(Header));
 
 		size_t allocation_size = size + adjustment;
 
@@ -44,10 +73,10 @@ void* FreeListAllocator::Allocate(size_t size, uint8_t alignment)
 			continue;
 		}
 
-		static_assert(sizeof Header >= sizeof FreeBlock, "Size of Header cannot be less than FreeBlock at this point");
+		static_assert(sizeof(Header) >= sizeof(FreeBlock), "Size of Header cannot be less than FreeBlock at this point");
 
 		// If allocation is not possible in the remaining memory.
-		if (free_block->size - allocation_size <= sizeof Header)
+		if (free_block->size - allocation_size <= sizeof(Header))
 		{
 			// Increase size, instead of creating new FreeBlock.
 			allocation_size = free_block->size;
@@ -80,9 +109,9 @@ void* FreeListAllocator::Allocate(size_t size, uint8_t alignment)
 
 		const uintptr_t aligned_address = reinterpret_cast<uintptr_t>(free_block) + adjustment;
 
-		Header *const header = reinterpret_cast<Header*>(aligned_address - sizeof Header);
+		Header *const header = reinterpret_cast<Header*>(aligned_address - sizeof(Header));
 		header->size = allocation_size;
-		header->adjustment = adjustment;
+		StoreAdjustment(header, adjustment);
 
 		m_UsedMemory += allocation_size;
 		m_Allocations++;
@@ -96,16 +125,186 @@ void* FreeListAllocator::Allocate(size_t size, uint8_t alignment)
 	return nullptr;
 }
 
+void* FreeListAllocator::AllocateSized(size_t size, size_t alignment)
+{
+	// Every block is a multiple of sizeof FreeBlock, so any remainder can hold a FreeBlock.
+	size = RoundUp(size, sizeof(FreeBlock));
+
+	FreeBlock *prev_free_block = nullptr;
+	FreeBlock *free_block = m_FreeBlock;
+
+	while (free_block)
+	{
+		// Blocks are aligned to sizeof FreeBlock, so usually there's nothing to adjust.
+		const size_t adjustment = AdjustmentFromAlign(free_block, alignment);
+
+		if (free_block->size < size + adjustment)
+		{
+			prev_free_block = free_block;
+			free_block = free_block->next;
+			continue;
+		}
+
+		const uintptr_t aligned_address = reinterpret_cast<uintptr_t>(free_block) + adjustment;
+		const size_t remaining_size = free_block->size - size - adjustment;
+		FreeBlock *next_block = free_block->next;
+
+		// Memory after the allocation stays free.
+		if (remaining_size > 0)
+		{
+			FreeBlock *const new_block = reinterpret_cast<FreeBlock*>(aligned_address + size);
+			new_block->size = remaining_size;
+			new_block->next = next_block;
+			next_block = new_block;
+		}
+
+		// So does the padding in front of it, which is a multiple of sizeof FreeBlock.
+		if (adjustment > 0)
+		{
+			free_block->size = adjustment;
+			free_block->next = next_block;
+		}
+		else if (prev_free_block)
+		{
+			prev_free_block->next = next_block;
+		}
+		else
+		{
+			m_FreeBlock = next_block;
+		}
+
+		m_UsedMemory += size;
+		m_Allocations++;
+
+		return reinterpret_cast<void*>(aligned_address);
+	}
+
+	return nullptr;
+}
+
+alloc::Allocation FreeListAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	void *const address = Allocate(size, alignment);
+
+	if (!address)
+	{
+		return{ nullptr, 0 };
+	}
+
+	// Sized blocks are exactly the rounded size.
+	if (m_Frees == alloc::Frees::Sized)
+	{
+		return{ address, RoundUp(size, sizeof(FreeBlock)) };
+	}
+
+	return{ address, GetAllocationSize(address) };
+}
+
+size_t FreeListAllocator::GetAllocationSize(void *address) const
+{
+	assert(m_Frees == alloc::Frees::Unsized);
+
+	// The header covers the whole block, including a remainder too small to split off.
+	const Header *header = reinterpret_cast<Header*>(Subtract(address, sizeof(Header)));
+
+	return header->size - LoadAdjustment(header);
+}
+
+void* FreeListAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	if (!address)
+	{
+		return Allocate(new_size, alignment);
+	}
+
+	Header *header = nullptr;
+	uintptr_t block_start;
+	size_t block_size;
+	size_t needed_size;
+	// Smallest tail worth splitting off, same as in Allocate.
+	size_t min_remainder;
+
+	if (m_Frees == alloc::Frees::Sized)
+	{
+		block_start = reinterpret_cast<uintptr_t>(address);
+		block_size = RoundUp(old_size, sizeof(FreeBlock));
+		needed_size = RoundUp(new_size, sizeof(FreeBlock));
+		min_remainder = 0;
+	}
+	else
+	{
+		header = reinterpret_cast<Header*>(Subtract(address, sizeof(Header)));
+
+		const size_t adjustment = LoadAdjustment(header);
+
+		block_start = reinterpret_cast<uintptr_t>(address) - adjustment;
+		block_size = header->size;
+		needed_size = new_size + adjustment;
+		min_remainder = sizeof(Header);
+	}
+
+	if (needed_size > block_size)
+	{
+		const size_t taken = TakeFrom(block_start + block_size, needed_size - block_size);
+
+		// No free neighbour big enough, move the allocation.
+		if (taken == 0)
+		{
+			return Allocator::Reallocate(address, old_size, new_size, alignment);
+		}
+
+		block_size += taken;
+		m_UsedMemory += taken;
+	}
+	else if (block_size - needed_size > min_remainder)
+	{
+		Free(block_start + needed_size, block_size - needed_size);
+
+		// Free() counts a deallocation, but the allocation is still live.
+		m_Allocations++;
+
+		block_size = needed_size;
+	}
+
+	if (header)
+	{
+		header->size = block_size;
+	}
+
+	return address;
+}
+
 void FreeListAllocator::Deallocate(void *address)
 {
 	assert(address);
+	assert(m_Frees == alloc::Frees::Unsized && "Allocator expects sized deallocations");
 
-	const Header *header = reinterpret_cast<Header*>(Subtract(address, sizeof Header));
+	const Header *header = reinterpret_cast<Header*>(Subtract(address, sizeof(Header)));
 
 	// Size of the FreeBlock.
 	const size_t block_size = header->size;
 	// Start of the FreeBlock, by removing adjustment used.
-	const uintptr_t block_start = reinterpret_cast<uintptr_t>(address) - header->adjustment;
+	const uintptr_t block_start = reinterpret_cast<uintptr_t>(address) - LoadAdjustment(header);
+
+	Free(block_start, block_size);
+}
+
+void FreeListAllocator::Deallocate(void *address, size_t size, size_t alignment_not_used)
+{
+	assert(address);
+
+	if (m_Frees == alloc::Frees::Unsized)
+	{
+		Deallocate(address);
+		return;
+	}
+
+	// Padding in front of the allocation was left in the list as its own block.
+	Free(reinterpret_cast<uintptr_t>(address), RoundUp(size, sizeof(FreeBlock)));
+}
+
+void FreeListAllocator::Free(uintptr_t block_start, size_t block_size)
+{
 	// End of the FreeBlock.
 	const uintptr_t block_end = block_start + block_size;
 
@@ -134,10 +333,10 @@ void FreeListAllocator::Deallocate(void *address)
 
 		m_FreeBlock = prev_free_block;
 	}
-	// Simply set the size if the previous FreeBlock is the adjacent one.
+	// Grow the previous FreeBlock if it's the adjacent one.
 	else if (reinterpret_cast<uintptr_t>(prev_free_block) + prev_free_block->size == block_start)
 	{
-		prev_free_block->size = block_size;
+		prev_free_block->size += block_size;
 	}
 	// If no previous block, probably last block, so simply replace the previous one with current FreeBlock.
 	else
@@ -160,3 +359,50 @@ void FreeListAllocator::Deallocate(void *address)
 	m_UsedMemory -= block_size;
 	m_Allocations--;
 }
+
+size_t FreeListAllocator::TakeFrom(uintptr_t block_start, size_t size)
+{
+	FreeBlock *prev_free_block = nullptr;
+	FreeBlock *free_block = m_FreeBlock;
+
+	// Blocks are kept in address order.
+	while (free_block && reinterpret_cast<uintptr_t>(free_block) < block_start)
+	{
+		prev_free_block = free_block;
+		free_block = free_block->next;
+	}
+
+	if (!free_block || reinterpret_cast<uintptr_t>(free_block) != block_start || free_block->size < size)
+	{
+		return 0;
+	}
+
+	FreeBlock *next_block = free_block->next;
+	const size_t min_remainder = m_Frees == alloc::Frees::Sized ? 0 : sizeof(Header);
+
+	if (free_block->size - size > min_remainder)
+	{
+		// May overlap free_block, so read its size before writing.
+		const size_t remaining_size = free_block->size - size;
+
+		FreeBlock *const new_block = reinterpret_cast<FreeBlock*>(block_start + size);
+		new_block->size = remaining_size;
+		new_block->next = next_block;
+		next_block = new_block;
+	}
+	else
+	{
+		size = free_block->size;
+	}
+
+	if (prev_free_block)
+	{
+		prev_free_block->next = next_block;
+	}
+	else
+	{
+		m_FreeBlock = next_block;
+	}
+
+	return size;
+}
@@ -1,10 +1,18 @@
 #include "LinearAllocator.h"
 
 using alloc::math::AdjustmentFromAlign;
+using alloc::math::Add;
 
-LinearAllocator::LinearAllocator(size_t size) :
-	Allocator(size),
-	m_CurrentPosition(m_Start)
+namespace
+{
+	// Each Clear() moves the high-water mark 1/2^kDecayShift of the way down to the last peak.
+	const unsigned kDecayShift = 2;
+}
+
+LinearAllocator::LinearAllocator(size_t size, alloc::Source const &source) :
+	Allocator(size, source),
+	m_CurrentPosition(m_Start),
+	m_HighWater(0)
 {
 	assert(size > 0);
 }
@@ -16,11 +24,11 @@ LinearAllocator::~LinearAllocator()
 	m_CurrentPosition = nullptr;
 }
 
-void* LinearAllocator::Allocate(size_t size, uint8_t alignment)
+void* LinearAllocator::Allocate(size_t size, size_t alignment)
 {
 	assert(size != 0);
 
-	const uint8_t adjustment = AdjustmentFromAlign(m_CurrentPosition, alignment);
+	const size_t adjustment = AdjustmentFromAlign(m_CurrentPosition, alignment);
 
 	if (m_UsedMemory + adjustment + size > m_Size)
 	{
@@ -28,8 +36,14 @@ void* LinearAllocator::Allocate(size_t size, uint8_t alignment)
 	}
 
 	const uintptr_t aligned_address = reinterpret_cast<uintptr_t>(m_CurrentPosition) + adjustment;
+	void *const end = reinterpret_cast<void*>(aligned_address + size);
 
-	m_CurrentPosition = reinterpret_cast<void*>(aligned_address + size);
+	if (end > m_Committed && !CommitTo(end))
+	{
+		return nullptr;
+	}
+
+	m_CurrentPosition = end;
 
 	m_UsedMemory += size + adjustment;
 	m_Allocations++;
@@ -42,9 +56,81 @@ void LinearAllocator::Deallocate(void *address_not_used)
 	return void();
 }
 
+void LinearAllocator::Deallocate(void *address_not_used, size_t size_not_used, size_t alignment_not_used)
+{
+	return void();
+}
+
+void* LinearAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	// The last allocation ends at the current position, so just move it.
+	if (address && Add(address, old_size) == m_CurrentPosition)
+	{
+		void *const end = Add(address, new_size);
+
+		if (new_size > old_size)
+		{
+			if (m_UsedMemory + new_size - old_size > m_Size)
+			{
+				return nullptr;
+			}
+
+			if (end > m_Committed && !CommitTo(end))
+			{
+				return nullptr;
+			}
+		}
+
+		m_CurrentPosition = end;
+		m_UsedMemory = m_UsedMemory - old_size + new_size;
+
+		return address;
+	}
+
+	// Anywhere else the tail is simply unused until Clear().
+	if (address && new_size <= old_size)
+	{
+		return address;
+	}
+
+	return Allocator::Reallocate(address, old_size, new_size, alignment);
+}
+
 void LinearAllocator::Clear()
 {
+	if (m_Backing == alloc::Backing::Virtual)
+	{
+		const size_t peak = reinterpret_cast<uintptr_t>(m_CurrentPosition) - reinterpret_cast<uintptr_t>(m_Start);
+
+		// Rise immediately, fall gradually.
+		if (peak >= m_HighWater)
+		{
+			m_HighWater = peak;
+		}
+		else
+		{
+			m_HighWater -= (m_HighWater - peak) >> kDecayShift;
+		}
+
+		DecommitFrom(Add(m_Start, m_HighWater));
+	}
+
 	m_Allocations = 0;
 	m_UsedMemory = 0;
 	m_CurrentPosition = m_Start;
 }
+
+LinearAllocator::Marker LinearAllocator::GetMarker() const
+{
+	return{ m_CurrentPosition, m_UsedMemory, m_Allocations };
+}
+
+void LinearAllocator::FreeToMarker(Marker const &marker)
+{
+	// Marker must have been taken from this allocator, before the current position.
+	assert(marker.position >= m_Start && marker.position <= m_CurrentPosition);
+
+	m_CurrentPosition = marker.position;
+	m_UsedMemory = marker.used_memory;
+	m_Allocations = marker.allocations;
+}
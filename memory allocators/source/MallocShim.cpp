@@ -0,0 +1,494 @@
+// malloc/free interposition for trying the allocators on whole programs, Linux only.
+// Build it as a shared library and preload it:
+//
+//   g++ -std=c++17 -O2 -DNDEBUG -shared -fPIC -pthread -Iinclude source/MallocShim.cpp source/Allocator.cpp source/FreeListAllocator.cpp source/PoolAllocator.cpp source/VirtualMemory.cpp -o libmemallocs.so
+//   LD_PRELOAD=./libmemallocs.so <program>
+//
+// The MallocShimTest tests in memory test/gtest.cpp check it when the test program is linked with this file or preloaded with it.
+//
+// Requests up to kMaxSmallSize go to size-class PoolAllocators, bigger or over-aligned ones to a FreeListAllocator.
+// Pools live in kChunkSize chunks, carved kChunksPerSlab at a time from aligned slabs of the FreeListAllocator,
+// which maps MEMALLOCS_ARENA_MB (default 1024) upfront. Pointers the shim didn't hand out are never freed, realloc fails on them.
+// A global spinlock serializes every call, the point is comparing the allocators, not the locking.
+//
+// Nothing in here calls malloc, so there's no recursion, and everything is set up on the first call
+// in static storage, so calls made before constructors run are fine too.
+#if defined(__linux__)
+
+#include "FreeListAllocator.h"
+#include "PoolAllocator.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <sched.h>
+
+using alloc::math::Add;
+
+namespace
+{
+	const size_t kChunkSize = 65536;
+	// Aligning a slab costs up to a chunk of padding in the free list, so it's shared by this many chunks.
+	const size_t kChunksPerSlab = 16;
+	const size_t kMaxSmallSize = 1024;
+	const size_t kMinAlignment = 16;
+	const size_t kDefaultArenaSize = 1024llu * 1024 * 1024;
+	const size_t kMaxArenaSize = 64llu * 1024 * 1024 * 1024;
+
+	// Multiples of kMinAlignment, so every object stays aligned.
+	const size_t kSizeClasses[] = { 16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024 };
+	const size_t kNumSizeClasses = sizeof(kSizeClasses) / sizeof(kSizeClasses[0]);
+
+	// Sits at the start of every pool chunk, the objects follow.
+	struct Chunk
+	{
+		Chunk(size_t size_class, void *objects, size_t objects_size) :
+			pool(objects_size, kSizeClasses[size_class], kMinAlignment, alloc::Source::FromBuffer(objects)),
+			next_partial(nullptr),
+			listed(false)
+		{
+		}
+
+		PoolAllocator pool;
+		// Next chunk of the same size class with free objects.
+		Chunk *next_partial;
+		// Whether the chunk is on the partial list.
+		bool listed;
+	};
+
+	const size_t kChunkHeaderSize = (sizeof(Chunk) + kMinAlignment - 1) & ~(kMinAlignment - 1);
+
+	class SpinLock
+	{
+		std::atomic_flag m_Flag = ATOMIC_FLAG_INIT;
+	public:
+		void Lock()
+		{
+			while (m_Flag.test_and_set(std::memory_order_acquire))
+			{
+				sched_yield();
+			}
+		}
+
+		void Unlock()
+		{
+			m_Flag.clear(std::memory_order_release);
+		}
+	};
+
+	SpinLock s_Lock;
+
+	// Set up in place on the first call, and never destroyed, the process may still free after exit handlers.
+	alignas(FreeListAllocator) unsigned char s_ArenaStorage[sizeof(FreeListAllocator)];
+	FreeListAllocator *s_Arena = nullptr;
+	bool s_Initialized = false;
+
+	// Size class + 1 of every kChunkSize window of the arena, 0 unless it's a pool chunk.
+	// Zero initialized, so it costs nothing until used.
+	uint8_t s_ChunkClasses[kMaxArenaSize / kChunkSize];
+	uintptr_t s_FirstWindow = 0;
+
+	// Windows of the current slab that aren't chunks yet.
+	uintptr_t s_NextChunk = 0;
+	uintptr_t s_SlabEnd = 0;
+
+	// Chunks with free objects, per size class.
+	Chunk *s_Partial[kNumSizeClasses];
+
+	// Size class for every (size + 15) / 16 up to kMaxSmallSize.
+	uint8_t s_ClassFromSize[kMaxSmallSize / kMinAlignment + 1];
+
+	struct Guard
+	{
+		Guard() { s_Lock.Lock(); }
+		~Guard() { s_Lock.Unlock(); }
+	};
+
+	size_t ArenaSize()
+	{
+		// getenv doesn't allocate.
+		const char *env = getenv("MEMALLOCS_ARENA_MB");
+		size_t size = 0;
+
+		for (; env && *env >= '0' && *env <= '9'; env++)
+		{
+			size = size * 10 + (*env - '0');
+		}
+
+		size *= 1024 * 1024;
+
+		return size == 0 || size > kMaxArenaSize ? kDefaultArenaSize : size;
+	}
+
+	// Under the lock.
+	bool Initialize()
+	{
+		if (s_Initialized)
+		{
+			return s_Arena != nullptr;
+		}
+
+		s_Initialized = true;
+
+		size_t size_class = 0;
+
+		for (size_t i = 0; i <= kMaxSmallSize / kMinAlignment; i++)
+		{
+			while (kSizeClasses[size_class] < i * kMinAlignment)
+			{
+				size_class++;
+			}
+
+			s_ClassFromSize[i] = static_cast<uint8_t>(size_class);
+		}
+
+		FreeListAllocator *arena = new(s_ArenaStorage) FreeListAllocator(ArenaSize(), alloc::Backing::Mapped);
+
+		if (!arena->GetStart())
+		{
+			return false;
+		}
+
+		s_Arena = arena;
+		s_FirstWindow = reinterpret_cast<uintptr_t>(arena->GetStart()) / kChunkSize;
+
+		return true;
+	}
+
+	uint8_t& ChunkClass(void *address)
+	{
+		return s_ChunkClasses[reinterpret_cast<uintptr_t>(address) / kChunkSize - s_FirstWindow];
+	}
+
+	Chunk* ChunkFromAddress(void *address)
+	{
+		return reinterpret_cast<Chunk*>(reinterpret_cast<uintptr_t>(address) & ~(kChunkSize - 1));
+	}
+
+	void* AllocateChunk()
+	{
+		if (s_NextChunk == s_SlabEnd)
+		{
+			void *slab = s_Arena->Allocate(kChunksPerSlab * kChunkSize, kChunkSize);
+
+			// Nearly full, a lone chunk may still fit.
+			if (!slab)
+			{
+				return s_Arena->Allocate(kChunkSize, kChunkSize);
+			}
+
+			s_NextChunk = reinterpret_cast<uintptr_t>(slab);
+			s_SlabEnd = s_NextChunk + kChunksPerSlab * kChunkSize;
+		}
+
+		void *chunk = reinterpret_cast<void*>(s_NextChunk);
+		s_NextChunk += kChunkSize;
+
+		return chunk;
+	}
+
+	void* AllocateSmall(size_t size_class)
+	{
+		while (Chunk *chunk = s_Partial[size_class])
+		{
+			void *address = chunk->pool.Allocate(kSizeClasses[size_class], kMinAlignment);
+
+			if (address)
+			{
+				return address;
+			}
+
+			// Full, it's listed again once an object is freed.
+			s_Partial[size_class] = chunk->next_partial;
+			chunk->listed = false;
+		}
+
+		void *memory = AllocateChunk();
+
+		if (!memory)
+		{
+			return nullptr;
+		}
+
+		Chunk *chunk = new(memory) Chunk(size_class, Add(memory, kChunkHeaderSize), kChunkSize - kChunkHeaderSize);
+		chunk->next_partial = nullptr;
+		chunk->listed = true;
+		s_Partial[size_class] = chunk;
+
+		ChunkClass(memory) = static_cast<uint8_t>(size_class + 1);
+
+		return chunk->pool.Allocate(kSizeClasses[size_class], kMinAlignment);
+	}
+
+	// Under the lock.
+	void* Allocate(size_t size, size_t alignment)
+	{
+		if (!Initialize())
+		{
+			return nullptr;
+		}
+
+		size = size ? size : 1;
+
+		if (size <= kMaxSmallSize && alignment <= kMinAlignment)
+		{
+			return AllocateSmall(s_ClassFromSize[(size + kMinAlignment - 1) / kMinAlignment]);
+		}
+
+		return s_Arena->Allocate(size, alignment < kMinAlignment ? kMinAlignment : alignment);
+	}
+
+	// Under the lock.
+	bool Owns(void *address)
+	{
+		return address && s_Arena && s_Arena->Owns(address);
+	}
+
+	// Under the lock.
+	void Deallocate(void *address)
+	{
+		// Memory from before the preload or from another allocator is left alone.
+		if (!Owns(address))
+		{
+			return;
+		}
+
+		const uint8_t chunk_class = ChunkClass(address);
+
+		if (chunk_class == 0)
+		{
+			s_Arena->Deallocate(address);
+			return;
+		}
+
+		const size_t size_class = chunk_class - 1;
+
+		Chunk *chunk = ChunkFromAddress(address);
+		chunk->pool.Deallocate(address);
+
+		if (!chunk->listed)
+		{
+			chunk->next_partial = s_Partial[size_class];
+			chunk->listed = true;
+			s_Partial[size_class] = chunk;
+		}
+	}
+
+	// Under the lock.
+	size_t UsableSize(void *address)
+	{
+		if (!Owns(address))
+		{
+			return 0;
+		}
+
+		const uint8_t chunk_class = ChunkClass(address);
+
+		return chunk_class == 0 ? s_Arena->GetAllocationSize(address) : kSizeClasses[chunk_class - 1];
+	}
+
+	void* AllocateOrErrno(size_t size, size_t alignment)
+	{
+		if ((alignment & (alignment - 1)) != 0)
+		{
+			errno = EINVAL;
+			return nullptr;
+		}
+
+		void *address;
+		{
+			Guard guard;
+			address = Allocate(size, alignment);
+		}
+
+		if (!address)
+		{
+			errno = ENOMEM;
+		}
+
+		return address;
+	}
+
+	void* AllocateOrThrow(size_t size, size_t alignment)
+	{
+		void *address;
+		{
+			Guard guard;
+			address = Allocate(size, alignment);
+		}
+
+		if (!address)
+		{
+			throw std::bad_alloc();
+		}
+
+		return address;
+	}
+
+	void Free(void *address)
+	{
+		Guard guard;
+		Deallocate(address);
+	}
+}
+
+extern "C"
+{
+	void* malloc(size_t size)
+	{
+		return AllocateOrErrno(size, kMinAlignment);
+	}
+
+	void free(void *address)
+	{
+		Free(address);
+	}
+
+	void* calloc(size_t count, size_t size)
+	{
+		if (size && count > static_cast<size_t>(-1) / size)
+		{
+			errno = ENOMEM;
+			return nullptr;
+		}
+
+		void *address = AllocateOrErrno(count * size, kMinAlignment);
+
+		if (address)
+		{
+			memset(address, 0, count * size);
+		}
+
+		return address;
+	}
+
+	void* realloc(void *address, size_t size)
+	{
+		if (!address)
+		{
+			return malloc(size);
+		}
+
+		if (size == 0)
+		{
+			free(address);
+			return nullptr;
+		}
+
+		size_t old_size;
+		{
+			Guard guard;
+
+			// Its size is unknown, so its contents can't be moved.
+			if (!Owns(address))
+			{
+				errno = ENOMEM;
+				return nullptr;
+			}
+
+			old_size = UsableSize(address);
+
+			// Big blocks resize in place in the free list where they can.
+			if (old_size > kMaxSmallSize && size > kMaxSmallSize)
+			{
+				void *new_address = s_Arena->Reallocate(address, old_size, size, kMinAlignment);
+
+				if (!new_address)
+				{
+					errno = ENOMEM;
+				}
+
+				return new_address;
+			}
+
+			if (old_size >= size)
+			{
+				return address;
+			}
+		}
+
+		void *new_address = malloc(size);
+
+		if (new_address)
+		{
+			memcpy(new_address, address, old_size);
+			free(address);
+		}
+
+		return new_address;
+	}
+
+	int posix_memalign(void **result, size_t alignment, size_t size)
+	{
+		if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+		{
+			return EINVAL;
+		}
+
+		Guard guard;
+		void *address = Allocate(size, alignment);
+
+		if (!address)
+		{
+			return ENOMEM;
+		}
+
+		*result = address;
+
+		return 0;
+	}
+
+	void* aligned_alloc(size_t alignment, size_t size)
+	{
+		return AllocateOrErrno(size, alignment);
+	}
+
+	void* memalign(size_t alignment, size_t size)
+	{
+		return AllocateOrErrno(size, alignment);
+	}
+
+	void* valloc(size_t size)
+	{
+		return AllocateOrErrno(size, alloc::vm::PageSize());
+	}
+
+	size_t malloc_usable_size(void *address)
+	{
+		Guard guard;
+		return UsableSize(address);
+	}
+
+	// Whether (@param address) came from the shim, for tests and for programs mixing it with another allocator.
+	int memallocs_owns(void *address)
+	{
+		Guard guard;
+		return Owns(address);
+	}
+}
+
+void* operator new(size_t size) { return AllocateOrThrow(size, kMinAlignment); }
+void* operator new[](size_t size) { return AllocateOrThrow(size, kMinAlignment); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept { return malloc(size); }
+void* operator new[](size_t size, std::nothrow_t const&) noexcept { return malloc(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return AllocateOrErrno(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return AllocateOrErrno(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void *address) noexcept { Free(address); }
+void operator delete[](void *address) noexcept { Free(address); }
+void operator delete(void *address, size_t size_not_used) noexcept { Free(address); }
+void operator delete[](void *address, size_t size_not_used) noexcept { Free(address); }
+void operator delete(void *address, std::align_val_t alignment_not_used) noexcept { Free(address); }
+void operator delete[](void *address, std::align_val_t alignment_not_used) noexcept { Free(address); }
+void operator delete(void *address, size_t size_not_used, std::align_val_t alignment_not_used) noexcept { Free(address); }
+void operator delete[](void *address, size_t size_not_used, std::align_val_t alignment_not_used) noexcept { Free(address); }
+void operator delete(void *address, std::nothrow_t const&) noexcept { Free(address); }
+void operator delete[](void *address, std::nothrow_t const&) noexcept { Free(address); }
+void operator delete(void *address, std::align_val_t alignment_not_used, std::nothrow_t const&) noexcept { Free(address); }
+void operator delete[](void *address, std::align_val_t alignment_not_used, std::nothrow_t const&) noexcept { Free(address); }
+
+#endif
@@ -0,0 +1,89 @@
+#include "MemoryResource.h"
+
+namespace alloc
+{
+	using detail::ResourceSize;
+
+	LinearResource::LinearResource(size_t size, Source const &source, std::pmr::memory_resource *upstream) :
+		m_Arena(size, source),
+		m_Upstream(upstream)
+	{
+		assert(upstream);
+	}
+
+	LinearResource::~LinearResource()
+	{
+		m_Arena.Clear();
+	}
+
+	void* LinearResource::do_allocate(size_t bytes, size_t alignment)
+	{
+		void *address = m_Arena.Allocate(ResourceSize(bytes), alignment);
+
+		// Throws std::bad_alloc when upstream is out of memory too.
+		return address ? address : m_Upstream->allocate(bytes, alignment);
+	}
+
+	void LinearResource::do_deallocate(void *address, size_t bytes, size_t alignment)
+	{
+		if (!m_Arena.Owns(address))
+		{
+			m_Upstream->deallocate(address, bytes, alignment);
+		}
+	}
+
+	bool LinearResource::do_is_equal(std::pmr::memory_resource const &other) const noexcept
+	{
+		return this == &other;
+	}
+
+	void LinearResource::Clear()
+	{
+		m_Arena.Clear();
+	}
+
+	PoolResource::PoolResource(size_t size, size_t obj_size, size_t obj_alignment, Source const &source, std::pmr::memory_resource *upstream) :
+		m_Pool(size, obj_size, obj_alignment, source),
+		m_ObjectSize(obj_size),
+		m_ObjectAlignment(obj_alignment),
+		m_Upstream(upstream)
+	{
+		assert(upstream);
+	}
+
+	PoolResource::~PoolResource()
+	{
+	}
+
+	void* PoolResource::do_allocate(size_t bytes, size_t alignment)
+	{
+		if (bytes <= m_ObjectSize && alignment <= m_ObjectAlignment)
+		{
+			void *address = m_Pool.AllocateAtLeast(ResourceSize(bytes), alignment).pointer;
+
+			if (address)
+			{
+				return address;
+			}
+		}
+
+		return m_Upstream->allocate(bytes, alignment);
+	}
+
+	void PoolResource::do_deallocate(void *address, size_t bytes, size_t alignment)
+	{
+		if (m_Pool.Owns(address))
+		{
+			m_Pool.Deallocate(address);
+		}
+		else
+		{
+			m_Upstream->deallocate(address, bytes, alignment);
+		}
+	}
+
+	bool PoolResource::do_is_equal(std::pmr::memory_resource const &other) const noexcept
+	{
+		return this == &other;
+	}
+}
@@ -0,0 +1,95 @@
+#include "NumaAllocator.h"
+
+NumaAllocator::NumaAllocator(std::function<Allocator*(unsigned node)> const &factory)
+{
+	const unsigned node_count = alloc::vm::NumaNodeCount();
+
+	for (unsigned node = 0; node < node_count; node++)
+	{
+		m_Nodes.push_back(factory(node));
+		assert(m_Nodes.back());
+	}
+}
+
+NumaAllocator::~NumaAllocator()
+{
+	for (Allocator *node_allocator : m_Nodes)
+	{
+		delete node_allocator;
+	}
+}
+
+void* NumaAllocator::Allocate(size_t size, size_t alignment)
+{
+	return NodeForThread().Allocate(size, alignment);
+}
+
+alloc::Allocation NumaAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	return NodeForThread().AllocateAtLeast(size, alignment);
+}
+
+void* NumaAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	Allocator &node_allocator = address ? NodeFromAddress(address) : NodeForThread();
+
+	return node_allocator.Reallocate(address, old_size, new_size, alignment);
+}
+
+void NumaAllocator::Deallocate(void *address)
+{
+	NodeFromAddress(address).Deallocate(address);
+}
+
+void NumaAllocator::Deallocate(void *address, size_t size, size_t alignment)
+{
+	NodeFromAddress(address).Deallocate(address, size, alignment);
+}
+
+bool NumaAllocator::Owns(void *address) const
+{
+	for (Allocator *node_allocator : m_Nodes)
+	{
+		if (node_allocator->Owns(address))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+Allocator& NumaAllocator::NodeFromAddress(void *address) const
+{
+	for (Allocator *node_allocator : m_Nodes)
+	{
+		if (node_allocator->Owns(address))
+		{
+			return *node_allocator;
+		}
+	}
+
+	assert(false && "Address doesn't belong to any node");
+
+	return *m_Nodes[0];
+}
+
+Allocator& NumaAllocator::NodeForThread() const
+{
+	unsigned node = alloc::vm::CurrentNumaNode();
+
+	// Nodes may come online after start-up.
+	if (node >= m_Nodes.size())
+	{
+		node = 0;
+	}
+
+	return *m_Nodes[node];
+}
+
+Allocator& NumaAllocator::GetNodeAllocator(unsigned node) const
+{
+	assert(node < m_Nodes.size());
+
+	return *m_Nodes[node];
+}
@@ -3,16 +3,25 @@
 using alloc::math::AdjustmentFromAlign;
 using alloc::math::Add;
 
-PoolAllocator::PoolAllocator(size_t size, size_t obj_size, uint8_t obj_alignment) :
-	Allocator(size),
+PoolAllocator::PoolAllocator(size_t size, size_t obj_size, size_t obj_alignment, alloc::Source const &source) :
+	Allocator(size, source),
 	m_ObjectSize(obj_size),
 	m_ObjectAlignment(obj_alignment)
 {
 	// When blocks are freed, they store a pointer to the next free block.
 	assert(obj_size >= sizeof(void*));
+	// The free list is threaded through all of the memory upfront.
+	assert(source.backing != alloc::Backing::Virtual);
+
+	// Out of memory, e.g. the parent is full, leaves the pool empty.
+	if (!m_Start)
+	{
+		m_FreeList = nullptr;
+		return;
+	}
 
 	// For keeping the alloc properly aligned.
-	uint8_t adjustment = AdjustmentFromAlign(m_Start, obj_alignment);
+	size_t adjustment = AdjustmentFromAlign(m_Start, obj_alignment);
 
 	// Start of the FreeList.
 	// Essentially adding a pointer for the aligned address to hold.
@@ -45,7 +54,7 @@ PoolAllocator::~PoolAllocator()
 	m_FreeList = nullptr;
 }
 
-void* PoolAllocator::Allocate(size_t size, uint8_t alignment)
+void* PoolAllocator::Allocate(size_t size, size_t alignment)
 {
 	assert(size == m_ObjectSize && alignment == m_ObjectAlignment);
 
@@ -67,6 +76,25 @@ void* PoolAllocator::Allocate(size_t size, uint8_t alignment)
 	return next_free_address;
 }
 
+alloc::Allocation PoolAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	assert(size <= m_ObjectSize && alignment <= m_ObjectAlignment);
+
+	void *const address = Allocate(m_ObjectSize, m_ObjectAlignment);
+
+	return{ address, address ? m_ObjectSize : 0 };
+}
+
+void* PoolAllocator::Reallocate(void *address, size_t old_size_not_used, size_t new_size, size_t alignment)
+{
+	if (new_size > m_ObjectSize)
+	{
+		return nullptr;
+	}
+
+	return address ? address : AllocateAtLeast(new_size, alignment).pointer;
+}
+
 void PoolAllocator::Deallocate(void *address)
 {
 	assert(address && "Address is a nullptr, usually indicating not enough memory on PoolAllocator");
@@ -80,3 +108,11 @@ void PoolAllocator::Deallocate(void *address)
 	m_UsedMemory -= m_ObjectSize;
 	m_Allocations--;
 }
+
+void PoolAllocator::Deallocate(void *address, size_t size, size_t alignment_not_used)
+{
+	// Every object has the same size, the pool never needed a header.
+	assert(size <= m_ObjectSize);
+
+	Deallocate(address);
+}
@@ -1,7 +1,8 @@
 #include "ProxyAllocator.h"
 
+// Shares the memory range of the wrapped allocator instead of allocating its own.
 ProxyAllocator::ProxyAllocator(Allocator& alloc) :
-	Allocator(alloc.GetSize()),
+	Allocator(alloc.GetSize(), alloc::Source::FromBuffer(alloc.GetStart())),
 	m_Allocator(alloc)
 {
 }
@@ -10,7 +11,7 @@ ProxyAllocator::~ProxyAllocator()
 {
 }
 
-void* ProxyAllocator::Allocate(size_t size, uint8_t alignment)
+void* ProxyAllocator::Allocate(size_t size, size_t alignment)
 {
 	assert(size != 0);
 
@@ -25,6 +26,38 @@ void* ProxyAllocator::Allocate(size_t size, uint8_t alignment)
 	return address;
 }
 
+alloc::Allocation ProxyAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	assert(size != 0);
+
+	m_Allocations++;
+
+	size_t prev_mem = m_Allocator.GetUsedMemory();
+
+	const alloc::Allocation allocation = m_Allocator.AllocateAtLeast(size, alignment);
+
+	m_UsedMemory += m_Allocator.GetUsedMemory() - prev_mem;
+
+	return allocation;
+}
+
+void* ProxyAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	size_t prev_mem = m_Allocator.GetUsedMemory();
+
+	void *new_address = m_Allocator.Reallocate(address, old_size, new_size, alignment);
+
+	if (new_address && !address)
+	{
+		m_Allocations++;
+	}
+
+	// Used memory can go either way.
+	m_UsedMemory = m_UsedMemory + m_Allocator.GetUsedMemory() - prev_mem;
+
+	return new_address;
+}
+
 void ProxyAllocator::Deallocate(void *address)
 {
 	m_Allocations--;
@@ -35,3 +68,14 @@ void ProxyAllocator::Deallocate(void *address)
 
 	m_UsedMemory -= prev_mem - m_Allocator.GetUsedMemory();
 }
+
+void ProxyAllocator::Deallocate(void *address, size_t size, size_t alignment)
+{
+	m_Allocations--;
+
+	size_t prev_mem = m_Allocator.GetUsedMemory();
+
+	m_Allocator.Deallocate(address, size, alignment);
+
+	m_UsedMemory -= prev_mem - m_Allocator.GetUsedMemory();
+}
@@ -0,0 +1,75 @@
+#include "Scratch.h"
+
+namespace alloc
+{
+	namespace
+	{
+		// Created on first use, released when the thread exits.
+		thread_local std::unique_ptr<LinearAllocator> t_ScratchArenas[kScratchArenas];
+	}
+
+	Scratch::Scratch(LinearAllocator &arena) :
+		m_Arena(&arena),
+		m_Marker(arena.GetMarker())
+	{
+	}
+
+	Scratch::Scratch(std::unique_ptr<LinearAllocator> arena) :
+		m_Arena(arena.get()),
+		m_Marker(arena->GetMarker()),
+		m_OwnArena(std::move(arena))
+	{
+	}
+
+	Scratch::Scratch(Scratch &&other) :
+		m_Arena(other.m_Arena),
+		m_Marker(other.m_Marker),
+		m_OwnArena(std::move(other.m_OwnArena))
+	{
+		other.m_Arena = nullptr;
+	}
+
+	Scratch::~Scratch()
+	{
+		if (m_Arena)
+		{
+			m_Arena->FreeToMarker(m_Marker);
+		}
+	}
+
+	namespace detail
+	{
+		Scratch GetScratch(Allocator const *const *conflicts, size_t count)
+		{
+			for (unsigned i = 0; i < kScratchArenas; i++)
+			{
+				std::unique_ptr<LinearAllocator> &arena = t_ScratchArenas[i];
+				bool conflicting = false;
+
+				for (size_t j = 0; j < count; j++)
+				{
+					if (arena && conflicts[j] == arena.get())
+					{
+						conflicting = true;
+						break;
+					}
+				}
+
+				if (conflicting)
+				{
+					continue;
+				}
+
+				if (!arena)
+				{
+					arena.reset(new LinearAllocator(kScratchReserve, Backing::Virtual));
+				}
+
+				return Scratch(*arena);
+			}
+
+			// Every arena conflicts, a fresh one costs a reservation, but never hands out the caller's memory.
+			return Scratch(std::unique_ptr<LinearAllocator>(new LinearAllocator(kScratchReserve, Backing::Virtual)));
+		}
+	}
+}
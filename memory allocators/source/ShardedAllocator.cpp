@@ -0,0 +1,156 @@
+#include "ShardedAllocator.h"
+
+#include <atomic>
+#include <thread>
+
+using alloc::math::Add;
+
+namespace
+{
+	// Handed out to threads in order of their first allocation, for alloc::ShardBy::RoundRobin.
+	std::atomic<unsigned> s_NextThreadSlot(0);
+	thread_local unsigned t_ThreadSlot = ~0u;
+}
+
+ShardedAllocator::Shard::Shard(size_t size, void *start) :
+	arena(size, alloc::Source::FromBuffer(start)),
+	locked(arena)
+{
+}
+
+ShardedAllocator::ShardedAllocator(size_t size, unsigned shards, alloc::ShardBy shard_by, alloc::Source const &source) :
+	Allocator(size, source),
+	m_NumShards(shards ? shards : std::thread::hardware_concurrency()),
+	m_ShardBy(shard_by)
+{
+	// Every shard's memory is split up front.
+	assert(source.backing != alloc::Backing::Virtual);
+
+	if (m_NumShards == 0)
+	{
+		m_NumShards = 1;
+	}
+
+	// Keep shard starts on cache lines too.
+	m_ShardSize = (size / m_NumShards) & ~static_cast<size_t>(63);
+	assert(m_ShardSize > 0);
+
+	m_Shards.reset(new std::unique_ptr<Shard>[m_NumShards]);
+
+	for (unsigned i = 0; i < m_NumShards; i++)
+	{
+		m_Shards[i].reset(new Shard(m_ShardSize, Add(m_Start, i * m_ShardSize)));
+	}
+}
+
+ShardedAllocator::~ShardedAllocator()
+{
+}
+
+unsigned ShardedAllocator::ShardForThread() const
+{
+	// Without real CPU numbers every thread would land on shard 0, spread them round robin instead.
+	if (m_ShardBy == alloc::ShardBy::Cpu && alloc::vm::CurrentCpuSupported())
+	{
+		return alloc::vm::CurrentCpu() % m_NumShards;
+	}
+
+	if (t_ThreadSlot == ~0u)
+	{
+		t_ThreadSlot = s_NextThreadSlot.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return t_ThreadSlot % m_NumShards;
+}
+
+ShardedAllocator::Shard& ShardedAllocator::ShardFromAddress(void *address) const
+{
+	const size_t index = (reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(m_Start)) / m_ShardSize;
+
+	assert(index < m_NumShards && m_Shards[index]->arena.Owns(address));
+
+	return *m_Shards[index];
+}
+
+void* ShardedAllocator::Allocate(size_t size, size_t alignment)
+{
+	return ShardedAllocator::AllocateAtLeast(size, alignment).pointer;
+}
+
+alloc::Allocation ShardedAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	const unsigned first = ShardForThread();
+
+	// Own shard first, then the others in turn once it's full.
+	for (unsigned i = 0; i < m_NumShards; i++)
+	{
+		const alloc::Allocation allocation = m_Shards[(first + i) % m_NumShards]->locked.AllocateAtLeast(size, alignment);
+
+		if (allocation.pointer)
+		{
+			return allocation;
+		}
+	}
+
+	return{ nullptr, 0 };
+}
+
+void ShardedAllocator::Deallocate(void *address)
+{
+	ShardFromAddress(address).locked.Deallocate(address);
+}
+
+void ShardedAllocator::Deallocate(void *address, size_t size, size_t alignment)
+{
+	ShardFromAddress(address).locked.Deallocate(address, size, alignment);
+}
+
+void* ShardedAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	if (!address)
+	{
+		return Allocate(new_size, alignment);
+	}
+
+	void *new_address = ShardFromAddress(address).locked.Reallocate(address, old_size, new_size, alignment);
+
+	return new_address ? new_address : Allocator::Reallocate(address, old_size, new_size, alignment);
+}
+
+size_t ShardedAllocator::GetUsedMemory() const
+{
+	size_t used_memory = 0;
+
+	for (unsigned i = 0; i < m_NumShards; i++)
+	{
+		used_memory += m_Shards[i]->locked.GetUsedMemory();
+	}
+
+	return used_memory;
+}
+
+size_t ShardedAllocator::GetNumAllocations() const
+{
+	size_t allocations = 0;
+
+	for (unsigned i = 0; i < m_NumShards; i++)
+	{
+		allocations += m_Shards[i]->locked.GetNumAllocations();
+	}
+
+	return allocations;
+}
+
+FreeListAllocator& ShardedAllocator::GetShard(unsigned index) const
+{
+	assert(index < m_NumShards);
+
+	return m_Shards[index]->arena;
+}
+
+alloc::LockStats ShardedAllocator::GetShardStats(unsigned index) const
+{
+	assert(index < m_NumShards);
+
+	return m_Shards[index]->locked.GetStats();
+}
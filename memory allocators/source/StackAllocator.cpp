@@ -3,13 +3,33 @@
 using alloc::math::AdjustmentFromAlignWithHeader;
 using alloc::math::Add;
 using alloc::math::Subtract;
+using alloc::math::AdjustmentFromAlign;
+using alloc::math::StoreAdjustment;
+using alloc::math::LoadAdjustment;
 
-StackAllocator::StackAllocator(size_t size) :
-	Allocator(size),
-	m_CurrentPosition(m_Start)
+namespace
+{
+	// Granularity of sized allocations, the top of the stack stays aligned to it.
+	const size_t kGranule = 2 * sizeof(void*);
+
+	inline size_t RoundUp(size_t size, size_t granule)
+	{
+		return (size + granule - 1) & ~(granule - 1);
+	}
+}
+
+StackAllocator::StackAllocator(size_t size, alloc::Source const &source, alloc::Frees frees) :
+	Allocator(size, source),
+	m_CurrentPosition(m_Start),
+	m_Frees(frees)
 {
 	assert(size > 0);
 
+	if (frees == alloc::Frees::Sized)
+	{
+		m_CurrentPosition = Add(m_Start, AdjustmentFromAlign(m_Start, kGranule));
+	}
+
 #if _DEBUG
 	m_PreviousPosition = nullptr;
 #endif
@@ -25,30 +45,55 @@ StackAllocator::~StackAllocator()
 #endif
 }
 
-void* StackAllocator::Allocate(size_t size, uint8_t alignment)
+void* StackAllocator::Allocate(size_t size, size_t alignment)
 {
 	assert(size != 0);
 
-	const uint8_t adjustment = AdjustmentFromAlignWithHeader(m_CurrentPosition, alignment, sizeof Header);
+	size_t adjustment;
+
+	if (m_Frees == alloc::Frees::Sized)
+	{
+		size = RoundUp(size, kGranule);
+		adjustment = alignment <= kGranule ? 0 : AdjustmentFromAlignWithHeader(m_CurrentPosition, alignment, sizeof(Header));
+	}
+	else
+	{
+		adjustment = AdjustmentFromAlignWithHeader(m_CurrentPosition, alignment, sizeof(Header));
+	}
 
-	if (m_UsedMemory + adjustment + size > m_Size)
+	if (reinterpret_cast<uintptr_t>(m_CurrentPosition) + adjustment + size > reinterpret_cast<uintptr_t>(m_Start) + m_Size)
 	{
 		return nullptr;
 	}
 
 	void *aligned_address = Add(m_CurrentPosition, adjustment);
+	void *const end = Add(aligned_address, size);
 
-	Header *const header = reinterpret_cast<Header*>(Subtract(aligned_address, sizeof Header));
+	// Pages are committed as the stack grows, and kept when it shrinks.
+	if (end > m_Committed && !CommitTo(end))
+	{
+		return nullptr;
+	}
 
-	header->adjustment = adjustment;
+	if (m_Frees == alloc::Frees::Unsized)
+	{
+		Header *const header = reinterpret_cast<Header*>(Subtract(aligned_address, sizeof(Header)));
+
+		StoreAdjustment(header, adjustment);
 #if _DEBUG
-	header->prev_address = m_PreviousPosition;
+		header->prev_address = m_PreviousPosition;
 
-	m_PreviousPosition = aligned_address;
+		m_PreviousPosition = aligned_address;
 #endif
+	}
+	// Sized frees only need the header for over-aligned allocations.
+	else if (adjustment > 0)
+	{
+		StoreAdjustment(reinterpret_cast<Header*>(Subtract(aligned_address, sizeof(Header))), adjustment);
+	}
 
 	// Current top of the stack.
-	m_CurrentPosition = Add(aligned_address, size);
+	m_CurrentPosition = end;
 
 	// adjustment holds the size needed to fit the header so simply add it with the size requested.
 	m_UsedMemory += adjustment + size;
@@ -57,17 +102,72 @@ void* StackAllocator::Allocate(size_t size, uint8_t alignment)
 	return aligned_address;
 }
 
+alloc::Allocation StackAllocator::AllocateAtLeast(size_t size, size_t alignment)
+{
+	void *const address = Allocate(size, alignment);
+
+	if (!address)
+	{
+		return{ nullptr, 0 };
+	}
+
+	// Sized allocations are rounded to the granule, unsized ones end exactly at the top.
+	return{ address, m_Frees == alloc::Frees::Sized ? RoundUp(size, kGranule) : size };
+}
+
+void* StackAllocator::Reallocate(void *address, size_t old_size, size_t new_size, size_t alignment)
+{
+	if (!address)
+	{
+		return Allocate(new_size, alignment);
+	}
+
+	if (m_Frees == alloc::Frees::Sized)
+	{
+		old_size = RoundUp(old_size, kGranule);
+		new_size = RoundUp(new_size, kGranule);
+	}
+
+	// The top allocation ends at the current position, so just move it.
+	if (Add(address, old_size) == m_CurrentPosition)
+	{
+		void *const end = Add(address, new_size);
+
+		if (reinterpret_cast<uintptr_t>(end) > reinterpret_cast<uintptr_t>(m_Start) + m_Size)
+		{
+			return nullptr;
+		}
+
+		if (end > m_Committed && !CommitTo(end))
+		{
+			return nullptr;
+		}
+
+		m_CurrentPosition = end;
+		m_UsedMemory = m_UsedMemory - old_size + new_size;
+
+		return address;
+	}
+
+	// Unsized deallocation takes the size from the top of the stack, so a smaller size doesn't need recording.
+	// Anything else can't be resized in place, the caller has to allocate, copy and free.
+	return m_Frees == alloc::Frees::Unsized && new_size <= old_size ? address : nullptr;
+}
+
 void StackAllocator::Deallocate(void *address)
 {
+	assert(m_Frees == alloc::Frees::Unsized && "Allocator expects sized deallocations");
 	assert(address == m_PreviousPosition);
 
-	Header *header = reinterpret_cast<Header*>(Subtract(address, sizeof Header));
+	Header *header = reinterpret_cast<Header*>(Subtract(address, sizeof(Header)));
 
 	// m_CurrentPosition holds the aligned address and size, so subtract to get size and combine with adjustment.
-	m_UsedMemory -= reinterpret_cast<uintptr_t>(m_CurrentPosition) - reinterpret_cast<uintptr_t>(address) + header->adjustment;
+	const size_t adjustment = LoadAdjustment(header);
+
+	m_UsedMemory -= reinterpret_cast<uintptr_t>(m_CurrentPosition) - reinterpret_cast<uintptr_t>(address) + adjustment;
 
 	// Set current pos to previous by subtracting the adjusted needed to get the next aligned address.
-	m_CurrentPosition = Subtract(address, header->adjustment);
+	m_CurrentPosition = Subtract(address, adjustment);
 
 #if _DEBUG
 	m_PreviousPosition = header->prev_address;
@@ -75,3 +175,22 @@ void StackAllocator::Deallocate(void *address)
 
 	m_Allocations--;
 }
+
+void StackAllocator::Deallocate(void *address, size_t size, size_t alignment)
+{
+	if (m_Frees == alloc::Frees::Unsized)
+	{
+		Deallocate(address);
+		return;
+	}
+
+	size = RoundUp(size, kGranule);
+
+	assert(Add(address, size) == m_CurrentPosition && "Deallocations must be in reverse order");
+
+	const size_t adjustment = alignment <= kGranule ? 0 : LoadAdjustment(reinterpret_cast<Header*>(Subtract(address, sizeof(Header))));
+
+	m_UsedMemory -= size + adjustment;
+	m_CurrentPosition = Subtract(address, adjustment);
+	m_Allocations--;
+}
@@ -0,0 +1,120 @@
+#include "StlAllocator.h"
+
+#include <tuple>
+
+namespace alloc
+{
+	NodePools::NodePools(Allocator &parent, size_t chunk_size) :
+		m_Parent(parent),
+		m_ChunkSize(chunk_size)
+	{
+	}
+
+	NodePools::~NodePools()
+	{
+	}
+
+	NodePools::Pool& NodePools::GetPool(size_t size, size_t alignment)
+	{
+		// Free objects hold the next pointer, and every object must stay aligned.
+		size = size < sizeof(void*) ? sizeof(void*) : size;
+		size = (size + alignment - 1) & ~(alignment - 1);
+
+		const std::pair<size_t, size_t> key(size, alignment);
+
+		auto it = m_Pools.find(key);
+
+		if (it == m_Pools.end())
+		{
+			it = m_Pools.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(m_Parent, size, alignment, m_ChunkSize)).first;
+		}
+
+		return it->second;
+	}
+
+	NodePools::Pool::Pool(Allocator &parent, size_t obj_size, size_t obj_alignment, size_t chunk_size) :
+		m_Parent(parent),
+		m_ObjectSize(obj_size),
+		m_ObjectAlignment(obj_alignment),
+		m_ChunkSize(chunk_size),
+		m_Current(nullptr)
+	{
+		assert(chunk_size >= obj_size + obj_alignment);
+	}
+
+	void* NodePools::Pool::Allocate()
+	{
+		if (m_Current)
+		{
+			void *address = m_Current->Allocate(m_ObjectSize, m_ObjectAlignment);
+
+			if (address)
+			{
+				return address;
+			}
+		}
+
+		// Chunks may have room again after deallocations, newest first.
+		for (auto it = m_Chunks.rbegin(); it != m_Chunks.rend(); ++it)
+		{
+			void *address = (*it)->Allocate(m_ObjectSize, m_ObjectAlignment);
+
+			if (address)
+			{
+				m_Current = it->get();
+				return address;
+			}
+		}
+
+		std::unique_ptr<PoolAllocator> chunk(new PoolAllocator(m_ChunkSize, m_ObjectSize, m_ObjectAlignment, Source::FromParent(m_Parent, m_ObjectAlignment)));
+
+		// Parent is full.
+		if (!chunk->GetStart())
+		{
+			return nullptr;
+		}
+
+		m_Current = chunk.get();
+		m_Chunks.push_back(std::move(chunk));
+
+		return m_Current->Allocate(m_ObjectSize, m_ObjectAlignment);
+	}
+
+	void NodePools::Pool::Deallocate(void *address)
+	{
+		if (m_Current && m_Current->Owns(address))
+		{
+			m_Current->Deallocate(address);
+			return;
+		}
+
+		for (auto &chunk : m_Chunks)
+		{
+			if (chunk->Owns(address))
+			{
+				chunk->Deallocate(address);
+				return;
+			}
+		}
+
+		assert(false && "Address doesn't belong to the pool");
+	}
+
+	bool NodePools::Pool::Owns(void *address) const
+	{
+		if (m_Current && m_Current->Owns(address))
+		{
+			return true;
+		}
+
+		for (auto &chunk : m_Chunks)
+		{
+			if (chunk->Owns(address))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,357 @@
+#include "VirtualMemory.h"
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#endif
+
+namespace alloc { namespace vm
+{
+#ifdef _WIN32
+	size_t PageSize()
+	{
+		static const size_t page_size = []()
+		{
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return static_cast<size_t>(info.dwPageSize);
+		}();
+
+		return page_size;
+	}
+
+	void* Reserve(size_t size)
+	{
+		return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+	}
+
+	bool Commit(void *address, size_t size)
+	{
+		return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+	}
+
+	void Decommit(void *address, size_t size)
+	{
+		VirtualFree(address, size, MEM_DECOMMIT);
+	}
+
+	void Release(void *address, size_t size_not_used)
+	{
+		VirtualFree(address, 0, MEM_RELEASE);
+	}
+
+	void* MapHuge(size_t size, PageMode &mode)
+	{
+		// Needs the "Lock pages in memory" privilege, without it this simply fails.
+		const size_t large_page_size = GetLargePageMinimum();
+
+		if (large_page_size > 0)
+		{
+			const size_t rounded_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+			void *address = VirtualAlloc(nullptr, rounded_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+			if (address)
+			{
+				mode = PageMode::Huge;
+				return address;
+			}
+		}
+
+		// Windows has no transparent huge pages.
+		mode = PageMode::Small;
+
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+
+	bool TransparentHugePagesEnabled()
+	{
+		return false;
+	}
+
+	void UnmapHuge(void *address, size_t size_not_used)
+	{
+		VirtualFree(address, 0, MEM_RELEASE);
+	}
+
+	unsigned NumaNodeCount()
+	{
+		ULONG highest_node = 0;
+
+		return GetNumaHighestNodeNumber(&highest_node) ? highest_node + 1 : 1;
+	}
+
+	unsigned CurrentNumaNode()
+	{
+		PROCESSOR_NUMBER processor;
+		USHORT node = 0;
+
+		GetCurrentProcessorNumberEx(&processor);
+
+		return GetNumaProcessorNodeEx(&processor, &node) ? node : 0;
+	}
+
+	unsigned CurrentCpu()
+	{
+		return GetCurrentProcessorNumber();
+	}
+
+	bool CurrentCpuSupported()
+	{
+		return true;
+	}
+
+	bool Place(void *address, size_t size, Numa policy, unsigned node)
+	{
+		// Windows only places memory when it's allocated (VirtualAllocExNuma), committed pages follow first touch.
+		return policy == Numa::Default || policy == Numa::FirstTouch || NumaNodeCount() == 1;
+	}
+#else
+	size_t PageSize()
+	{
+		static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		return page_size;
+	}
+
+	void* Reserve(size_t size)
+	{
+		// MAP_NORESERVE, so untouched address space isn't counted against overcommit limits.
+		void *address = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+		return address == MAP_FAILED ? nullptr : address;
+	}
+
+	bool Commit(void *address, size_t size)
+	{
+		return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+	}
+
+	void Decommit(void *address, size_t size)
+	{
+		// Drop the pages first, mprotect alone keeps them resident.
+		madvise(address, size, MADV_DONTNEED);
+		mprotect(address, size, PROT_NONE);
+	}
+
+	void Release(void *address, size_t size)
+	{
+		munmap(address, size);
+	}
+
+	void* MapHuge(size_t size, PageMode &mode)
+	{
+		// Huge page mappings must be unmapped in whole huge pages.
+		const size_t rounded_size = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+#ifdef MAP_HUGETLB
+		// Only succeeds if huge pages were set aside, e.g. through /proc/sys/vm/nr_hugepages.
+		void *address = mmap(nullptr, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (address != MAP_FAILED)
+		{
+			mode = PageMode::Huge;
+			return address;
+		}
+#endif
+
+		// Over-map by a huge page, then trim both ends so the range starts on a 2MB boundary.
+		char *const mapping = static_cast<char*>(mmap(nullptr, rounded_size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+		if (mapping == MAP_FAILED)
+		{
+			mode = PageMode::Small;
+			return nullptr;
+		}
+
+		char *const aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(mapping) + kHugePageSize - 1) & ~static_cast<uintptr_t>(kHugePageSize - 1));
+		const size_t head = aligned - mapping;
+		const size_t tail = kHugePageSize - head;
+
+		if (head > 0)
+		{
+			munmap(mapping, head);
+		}
+
+		if (tail > 0)
+		{
+			munmap(aligned + rounded_size, tail);
+		}
+
+		mode = PageMode::Small;
+
+#ifdef MADV_HUGEPAGE
+		// Also succeeds with transparent huge pages set to "never", the memory just stays on small pages then.
+		if (madvise(aligned, rounded_size, MADV_HUGEPAGE) == 0 && TransparentHugePagesEnabled())
+		{
+			mode = PageMode::Transparent;
+		}
+#endif
+
+		return aligned;
+	}
+
+	bool TransparentHugePagesEnabled()
+	{
+		static const bool enabled = []()
+		{
+			// Lists every setting with the current one in brackets, e.g. "always [madvise] never".
+			FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+			char setting[16];
+			bool found = false;
+
+			if (!file)
+			{
+				return false;
+			}
+
+			while (fscanf(file, "%15s", setting) == 1)
+			{
+				if (setting[0] == '[')
+				{
+					found = strcmp(setting, "[always]") == 0 || strcmp(setting, "[madvise]") == 0;
+					break;
+				}
+			}
+
+			fclose(file);
+
+			return found;
+		}();
+
+		return enabled;
+	}
+
+	void UnmapHuge(void *address, size_t size)
+	{
+		munmap(address, (size + kHugePageSize - 1) & ~(kHugePageSize - 1));
+	}
+
+	unsigned NumaNodeCount()
+	{
+		static const unsigned node_count = []()
+		{
+			// Holds a list of ranges such as "0", "0-1" or "0,2-3", "possible" would also count nodes that aren't there.
+			FILE *file = fopen("/sys/devices/system/node/online", "r");
+			unsigned node = 0;
+			unsigned highest = 0;
+
+			if (!file)
+			{
+				return 1u;
+			}
+
+			// Nodes are numbered from 0, so the count is one past the highest, gaps included.
+			while (fscanf(file, "%u", &node) == 1)
+			{
+				highest = node > highest ? node : highest;
+
+				if (fgetc(file) == EOF)
+				{
+					break;
+				}
+			}
+
+			fclose(file);
+
+			return highest + 1;
+		}();
+
+		return node_count;
+	}
+
+	unsigned CurrentNumaNode()
+	{
+#ifdef SYS_getcpu
+		unsigned cpu = 0;
+		unsigned node = 0;
+
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+		{
+			return node;
+		}
+#endif
+		return 0;
+	}
+
+	unsigned CurrentCpu()
+	{
+		// Goes through the vDSO, no system call.
+		const int cpu = sched_getcpu();
+
+		return cpu < 0 ? 0 : static_cast<unsigned>(cpu);
+	}
+
+	bool CurrentCpuSupported()
+	{
+		// Fails with ENOSYS on kernels and sandboxes that don't report it.
+		static const bool supported = sched_getcpu() >= 0;
+
+		return supported;
+	}
+
+	bool Place(void *address, size_t size, Numa policy, unsigned node)
+	{
+		if (policy == Numa::Default || NumaNodeCount() == 1)
+		{
+			return true;
+		}
+
+#ifdef SYS_mbind
+		// From <numaif.h>, spelled out so there's no dependency on libnuma.
+		const int mpol_local = 4;
+		const int mpol_bind = 2;
+		const int mpol_interleave = 3;
+		const unsigned mpol_mf_move = 1 << 1;
+
+		const unsigned long max_nodes = sizeof(unsigned long) * 8;
+		unsigned long node_mask = 0;
+		int mode = mpol_local;
+
+		if (policy == Numa::Bind)
+		{
+			if (node >= max_nodes || node >= NumaNodeCount())
+			{
+				return false;
+			}
+
+			mode = mpol_bind;
+			node_mask = 1ul << node;
+		}
+		else if (policy == Numa::Interleave)
+		{
+			mode = mpol_interleave;
+			node_mask = NumaNodeCount() >= max_nodes ? ~0ul : (1ul << NumaNodeCount()) - 1;
+		}
+
+		// mbind wants whole pages.
+		const uintptr_t page_mask = static_cast<uintptr_t>(PageSize() - 1);
+		const uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~page_mask;
+		const uintptr_t end = (reinterpret_cast<uintptr_t>(address) + size + page_mask) & ~page_mask;
+
+		return syscall(SYS_mbind, start, end - start, mode, mode == mpol_local ? nullptr : &node_mask, max_nodes, mpol_mf_move) == 0;
+#else
+		return false;
+#endif
+	}
+#endif
+
+	void Prefault(void *address, size_t size)
+	{
+		const size_t page_size = PageSize();
+		volatile char *const start = static_cast<char*>(address);
+
+		// Write back what's there, so memory that's already in use stays intact.
+		for (size_t offset = 0; offset < size; offset += page_size)
+		{
+			start[offset] = start[offset];
+		}
+	}
+}}
@@ -3,12 +3,25 @@
 #include "FreeListAllocator.h"
 #include "PoolAllocator.h"
 #include "ProxyAllocator.h"
+#include "LockedAllocator.h"
+#include "ShardedAllocator.h"
+#include "RemoteFreeAllocator.h"
+#include "PerCpuCache.h"
+#include "DeferredFreeAllocator.h"
+#include "ConcurrentFreeListAllocator.h"
+#include "ThreadCache.h"
 
 #include "MyCounter.h"
 
 #include <iostream>
 #include <cstdarg>
 #include <stack>
+#include <random>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <vector>
+#include <mutex>
 
 #define SIZE_1MB 1048576
 #define SIZE_2MB 2097152
@@ -20,6 +33,10 @@
 #define NUM_16B_ALLOCS 10000
 #define NUM_256B_ALLOCS 1000
 #define NUM_2MB_ALLOCS 50
+#define NUM_DISPATCH_ALLOCS 1000000
+#define NUM_TRAVERSAL_STEPS 10000000
+#define NUM_THREADS 8
+#define NUM_THREAD_ALLOCS 200000
 
 using std::cout;
 using std::endl;
@@ -263,6 +280,492 @@ void BenchmarkPoolAllocator()
 	delete alloc;
 }
 
+// Same bump allocations, once through the virtual interface and once on the concrete type.
+void BenchmarkDispatch()
+{
+	LinearAllocator *alloc = new LinearAllocator(SIZE_ALLOC);
+	// volatile, so the compiler can't see the dynamic type and devirtualize the calls.
+	Allocator *volatile erased = alloc;
+	uintptr_t checksum = 0;
+
+	MyCounter counter;
+	counter.Start();
+
+	for (unsigned i = 0; i < NUM_DISPATCH_ALLOCS; i++)
+	{
+		checksum += reinterpret_cast<uintptr_t>(erased->Allocate(16, 8));
+	}
+
+	const double elapsed_virtual = counter.Elapsed();
+
+	alloc->Clear();
+	counter.Start();
+
+	for (unsigned i = 0; i < NUM_DISPATCH_ALLOCS; i++)
+	{
+		checksum += reinterpret_cast<uintptr_t>(alloc->Allocate(16, 8));
+	}
+
+	const double elapsed_direct = counter.Elapsed();
+
+	alloc->Clear();
+
+	printf("\nDispatch (%u allocations):\n  Virtual: %.2fms\n  Direct: %.2fms\n  (checksum %llu)\n", NUM_DISPATCH_ALLOCS, elapsed_virtual, elapsed_direct, checksum);
+
+	delete alloc;
+}
+
+// Pointer chase through one random cycle over SIZE_ALLOC bytes, so nearly every step lands on another page.
+// Compares regular pages with alloc::Backing::Huge, which cuts down on TLB misses.
+void BenchmarkHugePages()
+{
+	const char *page_modes[] = { "small", "huge", "transparent huge" };
+	const alloc::Backing backings[] = { alloc::Backing::Mapped, alloc::Backing::Huge };
+	const size_t count = SIZE_ALLOC / sizeof(size_t);
+
+	for (alloc::Backing backing : backings)
+	{
+		LinearAllocator *alloc = new LinearAllocator(SIZE_ALLOC, backing);
+		size_t *next = static_cast<size_t*>(alloc->Allocate(count * sizeof(size_t), 8));
+
+		// Sattolo's algorithm, gives a single cycle through every element.
+		std::mt19937_64 random(42);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			next[i] = i;
+		}
+
+		for (size_t i = count - 1; i > 0; i--)
+		{
+			std::swap(next[i], next[random() % i]);
+		}
+
+		MyCounter counter;
+		counter.Start();
+
+		size_t index = 0;
+
+		for (unsigned i = 0; i < NUM_TRAVERSAL_STEPS; i++)
+		{
+			index = next[index];
+		}
+
+		const double elapsed = counter.Elapsed();
+
+		printf("\nTraversal on %s pages: %.2fms\n  (last index %llu)\n", page_modes[static_cast<int>(alloc->GetPageMode())], elapsed, index);
+
+		alloc->Clear();
+		delete alloc;
+	}
+}
+
+// NUM_THREADS threads doing allocate/free pairs on one FreeListAllocator behind Lock.
+template<class Lock>
+void BenchmarkLocked(const char *lock_name)
+{
+	FreeListAllocator *alloc = new FreeListAllocator(SIZE_ALLOC);
+	alloc::LockedAllocator<FreeListAllocator, Lock> locked(*alloc);
+	std::vector<std::thread> threads;
+
+	MyCounter counter;
+	counter.Start();
+
+	for (unsigned t = 0; t < NUM_THREADS; t++)
+	{
+		threads.emplace_back([&locked]()
+		{
+			for (unsigned i = 0; i < NUM_THREAD_ALLOCS; i++)
+			{
+				locked.Deallocate(locked.Allocate(64, 8));
+			}
+		});
+	}
+
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	const double elapsed = counter.Elapsed();
+	const alloc::LockStats stats = locked.GetStats();
+
+	printf("\n%s (%u threads): %.2fms\n  Acquisitions: %llu\n  Contended: %llu\n  Waited: %.2fms\n", lock_name, NUM_THREADS, elapsed,
+		static_cast<unsigned long long>(stats.acquisitions), static_cast<unsigned long long>(stats.contended), stats.wait_ns / 1e6);
+
+	delete alloc;
+}
+
+void BenchmarkLocks()
+{
+	BenchmarkLocked<std::mutex>("std::mutex");
+	BenchmarkLocked<alloc::TicketLock>("TicketLock");
+	BenchmarkLocked<alloc::AdaptiveLock>("AdaptiveLock");
+}
+
+// NUM_THREADS threads doing allocate/free pairs on a ShardedAllocator, against one global lock above.
+void BenchmarkSharded()
+{
+	BenchmarkLocked<alloc::AdaptiveLock>("Global AdaptiveLock");
+
+	const alloc::ShardBy policies[] = { alloc::ShardBy::Cpu, alloc::ShardBy::RoundRobin };
+	const char *policy_names[] = { "CPU", "round robin" };
+
+	for (unsigned p = 0; p < 2; p++)
+	{
+		ShardedAllocator *alloc = new ShardedAllocator(SIZE_ALLOC, 0, policies[p]);
+		std::vector<std::thread> threads;
+
+		MyCounter counter;
+		counter.Start();
+
+		for (unsigned t = 0; t < NUM_THREADS; t++)
+		{
+			threads.emplace_back([alloc]()
+			{
+				for (unsigned i = 0; i < NUM_THREAD_ALLOCS; i++)
+				{
+					alloc->Deallocate(alloc->Allocate(64, 8));
+				}
+			});
+		}
+
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+
+		const double elapsed = counter.Elapsed();
+		size_t contended = 0;
+
+		for (unsigned i = 0; i < alloc->GetNumShards(); i++)
+		{
+			contended += alloc->GetShardStats(i).contended;
+		}
+
+		printf("\nSharded by %s (%u shards, %u threads): %.2fms\n  Contended: %llu\n", policy_names[p], alloc->GetNumShards(), NUM_THREADS, elapsed,
+			static_cast<unsigned long long>(contended));
+
+		delete alloc;
+	}
+}
+
+// A producer allocating 64 byte objects and a consumer freeing them, handed over in batches.
+// Alloc is called from the producer, Free from the consumer.
+template<class Alloc, class Free>
+double BenchmarkProducerConsumer(Alloc alloc_object, Free free_object)
+{
+	const unsigned batch_size = 1000;
+	std::vector<std::vector<void*>> batches;
+	std::mutex batches_lock;
+	bool done = false;
+
+	MyCounter counter;
+	counter.Start();
+
+	std::thread consumer([&]()
+	{
+		for (;;)
+		{
+			std::vector<std::vector<void*>> taken;
+			bool finished;
+			{
+				std::lock_guard<std::mutex> guard(batches_lock);
+				taken.swap(batches);
+				finished = done;
+			}
+
+			for (std::vector<void*> &batch : taken)
+			{
+				for (void *object : batch)
+				{
+					free_object(object);
+				}
+			}
+
+			if (finished && taken.empty())
+			{
+				break;
+			}
+
+			std::this_thread::yield();
+		}
+	});
+
+	for (unsigned i = 0; i < NUM_THREAD_ALLOCS / batch_size; i++)
+	{
+		std::vector<void*> batch;
+		batch.reserve(batch_size);
+
+		for (unsigned j = 0; j < batch_size; j++)
+		{
+			batch.push_back(alloc_object());
+		}
+
+		std::lock_guard<std::mutex> guard(batches_lock);
+		batches.push_back(std::move(batch));
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(batches_lock);
+		done = true;
+	}
+
+	consumer.join();
+
+	return counter.Elapsed();
+}
+
+void BenchmarkRemoteFrees()
+{
+	{
+		PoolAllocator *pool = new PoolAllocator(SIZE_ALLOC, 64, 8);
+		alloc::LockedAllocator<PoolAllocator> locked(*pool);
+
+		const double elapsed = BenchmarkProducerConsumer([&locked]() { return locked.Allocate(64, 8); }, [&locked](void *object) { locked.Deallocate(object); });
+
+		printf("\nProducer/consumer, locked pool: %.2fms\n", elapsed);
+
+		delete pool;
+	}
+
+	{
+		PoolAllocator *pool = new PoolAllocator(SIZE_ALLOC, 64, 8);
+		alloc::RemoteFreeAllocator<PoolAllocator> remote(*pool);
+
+		const double elapsed = BenchmarkProducerConsumer([&remote]() { return remote.Allocate(64, 8); }, [&remote](void *object) { remote.Deallocate(object); });
+		remote.Collect();
+
+		printf("Producer/consumer, remote frees: %.2fms\n  Remote frees: %llu\n", elapsed, static_cast<unsigned long long>(remote.GetNumRemoteFrees()));
+
+		delete pool;
+	}
+}
+
+// NUM_THREADS threads doing allocate/free pairs on a pool behind a per-CPU cache, against one lock.
+void BenchmarkPerCpuCache()
+{
+	{
+		PoolAllocator *pool = new PoolAllocator(SIZE_ALLOC, 64, 8);
+		alloc::LockedAllocator<PoolAllocator> locked(*pool);
+		std::vector<std::thread> threads;
+
+		MyCounter counter;
+		counter.Start();
+
+		for (unsigned t = 0; t < NUM_THREADS; t++)
+		{
+			threads.emplace_back([&locked]()
+			{
+				for (unsigned i = 0; i < NUM_THREAD_ALLOCS; i++)
+				{
+					locked.Deallocate(locked.Allocate(64, 8));
+				}
+			});
+		}
+
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+
+		printf("\nLocked pool (%u threads): %.2fms\n", NUM_THREADS, counter.Elapsed());
+
+		delete pool;
+	}
+
+	{
+		PoolAllocator *pool = new PoolAllocator(SIZE_ALLOC, 64, 8);
+		alloc::PerCpuCache<PoolAllocator> cache(*pool, 64, 8);
+		std::vector<std::thread> threads;
+
+		MyCounter counter;
+		counter.Start();
+
+		for (unsigned t = 0; t < NUM_THREADS; t++)
+		{
+			threads.emplace_back([&cache]()
+			{
+				for (unsigned i = 0; i < NUM_THREAD_ALLOCS; i++)
+				{
+					cache.Deallocate(cache.Allocate(64, 8));
+				}
+			});
+		}
+
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+
+		printf("Per-CPU cache (%u threads, %u slots, %s): %.2fms\n  Cached objects: %llu\n", NUM_THREADS, cache.GetNumSlots(),
+			cache.GetSlotBy() == alloc::SlotBy::Rseq ? "rseq" : cache.GetSlotBy() == alloc::SlotBy::Cpu ? "by CPU" : "by thread", counter.Elapsed(), static_cast<unsigned long long>(cache.GetCachedObjects()));
+
+		cache.Flush();
+		delete pool;
+	}
+}
+
+// Time the caller spends freeing NUM_16B_ALLOCS * 5 scattered blocks of a FreeListAllocator, directly and through a background thread.
+void BenchmarkDeferredFree()
+{
+	const unsigned count = NUM_16B_ALLOCS * 5;
+	std::vector<void*> blocks(count);
+	std::mt19937 random(1);
+
+	{
+		FreeListAllocator *alloc = new FreeListAllocator(SIZE_ALLOC);
+
+		for (void *&block : blocks)
+		{
+			block = alloc->Allocate(16 + random() % 240, 8);
+		}
+
+		std::shuffle(blocks.begin(), blocks.end(), random);
+
+		MyCounter counter;
+		counter.Start();
+
+		for (void *block : blocks)
+		{
+			alloc->Deallocate(block);
+		}
+
+		printf("\nFreeListAllocator, direct frees: %.2fms\n", counter.Elapsed());
+
+		delete alloc;
+	}
+
+	{
+		FreeListAllocator *alloc = new FreeListAllocator(SIZE_ALLOC);
+		alloc::DeferredFreeAllocator<FreeListAllocator> *deferred = new alloc::DeferredFreeAllocator<FreeListAllocator>(*alloc);
+
+		for (void *&block : blocks)
+		{
+			block = deferred->Allocate(16 + random() % 240, 8);
+		}
+
+		std::shuffle(blocks.begin(), blocks.end(), random);
+
+		MyCounter counter;
+		counter.Start();
+
+		for (void *block : blocks)
+		{
+			deferred->Deallocate(block);
+		}
+
+		const double elapsed = counter.Elapsed();
+
+		counter.Start();
+		deferred->Flush();
+
+		printf("FreeListAllocator, deferred frees: %.2fms on the caller, %.2fms until flushed\n  Batches: %llu\n", elapsed, counter.Elapsed(),
+			static_cast<unsigned long long>(deferred->GetNumBatches()));
+
+		delete deferred;
+		delete alloc;
+	}
+}
+
+// (@param num_threads) threads each keeping a window of 64 live allocations of 16 to 512 bytes, replacing one at random per step.
+// With (@param few_sizes) the sizes are picked from five common ones instead.
+template<class Alloc>
+double BenchmarkSharedHeap(Alloc &alloc, unsigned num_threads, bool few_sizes = false)
+{
+	static const size_t kFewSizes[] = { 24, 48, 64, 128, 200 };
+
+	std::vector<std::thread> threads;
+
+	MyCounter counter;
+	counter.Start();
+
+	for (unsigned t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([&alloc, few_sizes, t]()
+		{
+			std::mt19937 random(t);
+			void *window[64] = {};
+
+			for (unsigned i = 0; i < NUM_THREAD_ALLOCS / 4; i++)
+			{
+				void *&slot = window[random() % 64];
+
+				if (slot)
+				{
+					alloc.Deallocate(slot);
+				}
+
+				slot = alloc.Allocate(few_sizes ? kFewSizes[random() % 5] : 16 + random() % 497, 8);
+			}
+
+			for (void *address : window)
+			{
+				if (address)
+				{
+					alloc.Deallocate(address);
+				}
+			}
+		});
+	}
+
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	return counter.Elapsed();
+}
+
+// A lock per size class against one lock around a FreeListAllocator.
+void BenchmarkConcurrentFreeList()
+{
+	const unsigned thread_counts[] = { 1, 2, 4, 8, 16 };
+
+	printf("\nThreads  Global lock  Per-bin locks\n");
+
+	for (unsigned num_threads : thread_counts)
+	{
+		FreeListAllocator *freelist = new FreeListAllocator(SIZE_ALLOC);
+		alloc::LockedAllocator<FreeListAllocator> locked(*freelist);
+
+		const double global_elapsed = BenchmarkSharedHeap(locked, num_threads);
+
+		delete freelist;
+
+		ConcurrentFreeListAllocator *concurrent = new ConcurrentFreeListAllocator(SIZE_ALLOC);
+
+		const double bins_elapsed = BenchmarkSharedHeap(*concurrent, num_threads);
+
+		printf("%7u  %9.2fms  %11.2fms\n", num_threads, global_elapsed, bins_elapsed);
+
+		delete concurrent;
+	}
+}
+
+// NUM_THREADS threads allocating and freeing a handful of sizes, through a thread cache and through one lock.
+void BenchmarkThreadCache()
+{
+	{
+		FreeListAllocator *freelist = new FreeListAllocator(SIZE_ALLOC);
+		alloc::LockedAllocator<FreeListAllocator> locked(*freelist);
+
+		printf("\nLocked FreeListAllocator (%u threads): %.2fms\n", NUM_THREADS, BenchmarkSharedHeap(locked, NUM_THREADS, true));
+
+		delete freelist;
+	}
+
+	{
+		FreeListAllocator *freelist = new FreeListAllocator(SIZE_ALLOC);
+		alloc::ThreadCache<FreeListAllocator> *cache = new alloc::ThreadCache<FreeListAllocator>(*freelist);
+
+		printf("ThreadCache over FreeListAllocator (%u threads): %.2fms\n", NUM_THREADS, BenchmarkSharedHeap(*cache, NUM_THREADS, true));
+
+		delete cache;
+		delete freelist;
+	}
+}
+
 void TestLinearAlloc()
 {
 	LinearAllocator *alloc = new LinearAllocator(32);
@@ -421,6 +924,15 @@ int main(int agrc, char **agrv)
 	//BenchmarkStackAllocator();
 	//BenchmarkFreeListAllocator();
 	//BenchmarkPoolAllocator();
+	//BenchmarkDispatch();
+	//BenchmarkHugePages();
+	//BenchmarkLocks();
+	//BenchmarkSharded();
+	//BenchmarkRemoteFrees();
+	//BenchmarkPerCpuCache();
+	//BenchmarkDeferredFree();
+	//BenchmarkConcurrentFreeList();
+	//BenchmarkThreadCache();
 	
 	cout << endl;
 	system("pause");
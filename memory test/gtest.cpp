@@ -1,13 +1,51 @@
 #include "tests.h"
 #include "LinearAllocator.h"
 #include "StackAllocator.h"
+#include "ConcurrentLinearAllocator.h"
+#include "Scratch.h"
+#include "ArenaPool.h"
+#include "VirtualAllocator.h"
+#include "FreeListAllocator.h"
+#include "ProxyAllocator.h"
+#include "PoolAllocator.h"
+#include "NumaAllocator.h"
+#include "FallbackAllocator.h"
+#include "Segregator.h"
+#include "Bucketizer.h"
+#include "MemoryResource.h"
+#include "StlAllocator.h"
+#include "LockedAllocator.h"
+#include "ShardedAllocator.h"
+#include "RemoteFreeAllocator.h"
+#include "PerCpuCache.h"
+#include "EpochAllocator.h"
+#include "DeferredFreeAllocator.h"
+#include "ConcurrentFreeListAllocator.h"
+#include "ThreadCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sched.h>
+#endif
 
 namespace testing_basic
 {
 	TEST(AlignmentTest, AdjustmentFromAlignTest)
 	{
 		void *mem_test = reinterpret_cast<void*>(0xb);
-		uint8_t alignment = alloc::math::AdjustmentFromAlign(mem_test, 4);
+		size_t alignment = alloc::math::AdjustmentFromAlign(mem_test, 4);
 
 		ASSERT_EQ(alignment, 1llu);
 	}
@@ -16,7 +54,7 @@ namespace testing_basic
 	{
 		void *mem_test = reinterpret_cast<void*>(0xc);
 		void *mem_aligned = alloc::math::Align(mem_test, 8);
-		uint8_t alignment = alloc::math::AdjustmentFromAlign(mem_aligned, 8);
+		size_t alignment = alloc::math::AdjustmentFromAlign(mem_aligned, 8);
 
 		ASSERT_EQ(alignment, 0llu);
 	}
@@ -70,6 +108,58 @@ namespace testing_linear_alloc
 		alloc::unique_ptr<int> integer = alloc::make_unique<int>(alloc, 10);
 		ASSERT_EQ(10, *integer);
 	}
+
+	TEST(LinearAllocatorVirtual, CommitsAsItGrows)
+	{
+		const size_t size_1gb = 1024llu * 1024 * 1024;
+		LinearAllocator alloc(size_1gb, alloc::Backing::Virtual);
+		ASSERT_EQ(0llu, alloc.GetCommittedMemory());
+
+		char *mem = static_cast<char*>(alloc.Allocate(16, 8));
+		ASSERT_TRUE(mem != nullptr);
+		mem[15] = 1;
+		ASSERT_LT(alloc.GetCommittedMemory(), 1024llu * 1024);
+
+		char *big = static_cast<char*>(alloc.Allocate(8 * 1024 * 1024, 8));
+		ASSERT_TRUE(big != nullptr);
+		big[8 * 1024 * 1024 - 1] = 1;
+		ASSERT_GE(alloc.GetCommittedMemory(), 8llu * 1024 * 1024);
+		ASSERT_LT(alloc.GetCommittedMemory(), size_1gb);
+
+		ASSERT_TRUE(alloc.Allocate(size_1gb, 8) == nullptr);
+
+		alloc.Clear();
+	}
+
+	TEST(LinearAllocatorVirtual, ClearDecommitsAfterBurst)
+	{
+		const size_t size_16mb = 16 * 1024 * 1024;
+		LinearAllocator alloc(1024llu * 1024 * 1024, alloc::Backing::Virtual);
+
+		alloc.Allocate(size_16mb, 8);
+		alloc.Clear();
+		ASSERT_GE(alloc.GetCommittedMemory(), size_16mb);
+
+		// A single quiet cycle keeps most of the pages.
+		alloc.Allocate(1024, 8);
+		alloc.Clear();
+		ASSERT_GE(alloc.GetCommittedMemory(), size_16mb / 2);
+
+		for (int i = 0; i < 32; i++)
+		{
+			alloc.Allocate(1024, 8);
+			alloc.Clear();
+		}
+
+		ASSERT_LE(alloc.GetCommittedMemory(), 256llu * 1024);
+
+		// Memory is committed again on demand.
+		char *mem = static_cast<char*>(alloc.Allocate(size_16mb, 8));
+		ASSERT_TRUE(mem != nullptr);
+		mem[size_16mb - 1] = 1;
+
+		alloc.Clear();
+	}
 }
 
 namespace testing_stack_alloc
@@ -106,10 +196,1944 @@ namespace testing_stack_alloc
 		alloc::unique_ptr<int> integer = alloc::make_unique<int>(alloc, 123);
 		ASSERT_EQ(123, *integer);
 	}
+
+	TEST(StackAllocatorVirtual, CommitsAsItGrows)
+	{
+		StackAllocator alloc(1024llu * 1024 * 1024, alloc::Backing::Virtual);
+
+		char *mem = static_cast<char*>(alloc.Allocate(4 * 1024 * 1024, 8));
+		ASSERT_TRUE(mem != nullptr);
+		mem[4 * 1024 * 1024 - 1] = 1;
+		ASSERT_GE(alloc.GetCommittedMemory(), 4llu * 1024 * 1024);
+		ASSERT_LT(alloc.GetCommittedMemory(), 8llu * 1024 * 1024);
+
+		alloc.Deallocate(mem);
+	}
 }
 
-int main(int argc, char **argv)
+namespace testing_concurrent_linear_alloc
 {
-	testing::InitGoogleTest(&argc, argv);
+	struct ConcurrentLinearAllocator_F : testing::Test
+	{
+		ConcurrentLinearAllocator *alloc;
+
+		void SetUp() override
+		{
+			alloc = new ConcurrentLinearAllocator(1024 * 1024);
+		}
+
+		void TearDown() override
+		{
+			alloc->Clear();
+			delete alloc;
+		}
+	};
+
+	TEST_F(ConcurrentLinearAllocator_F, AllocationIsAligned)
+	{
+		alloc->Allocate(3, 1);
+		void *mem = alloc->Allocate(16, 16);
+		ASSERT_TRUE(mem != nullptr);
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, mem, 16);
+	}
+
+	TEST_F(ConcurrentLinearAllocator_F, OverflowReturnsNullptr)
+	{
+		ASSERT_TRUE(alloc->Allocate(1024 * 1000, 8) != nullptr);
+		ASSERT_TRUE(alloc->Allocate(1024 * 100, 8) == nullptr);
+		ASSERT_TRUE(alloc->Allocate(1024 * 100, 8) == nullptr);
+		ASSERT_GE(alloc->GetUsedMemory(), 1024 * 1000llu);
+		ASSERT_LT(alloc->GetUsedMemory(), alloc->GetSize());
+
+		alloc->Clear();
+		ASSERT_TRUE(alloc->Allocate(1024 * 100, 8) != nullptr);
+	}
+
+	TEST_F(ConcurrentLinearAllocator_F, BiggerThanTheWholeFails)
+	{
+		const size_t used = alloc->GetUsedMemory();
+
+		ASSERT_TRUE(alloc->Allocate(alloc->GetSize() + 1, 8) == nullptr);
+		ASSERT_TRUE(alloc->Allocate(~static_cast<size_t>(0), 8) == nullptr);
+		ASSERT_EQ(used, alloc->GetUsedMemory());
+	}
+
+	TEST_F(ConcurrentLinearAllocator_F, FailedAllocationLeavesRoom)
+	{
+		ASSERT_TRUE(alloc->Allocate(1024 * 1000, 8) != nullptr);
+		const size_t used = alloc->GetUsedMemory();
+
+		ASSERT_TRUE(alloc->Allocate(1024 * 100, 8) == nullptr);
+		ASSERT_EQ(used, alloc->GetUsedMemory());
+
+		void *mem = alloc->Allocate(1024 * 10, 8);
+		ASSERT_TRUE(mem != nullptr);
+		ASSERT_EQ(used + 1024 * 10, alloc->GetUsedMemory());
+	}
+
+	TEST_F(ConcurrentLinearAllocator_F, LeaseFallsBackToTheRemainder)
+	{
+		ConcurrentLinearAllocator::Lease lease(*alloc, 65536);
+
+		ASSERT_TRUE(alloc->Allocate(1024 * 1000, 8) != nullptr);
+		// Not enough left for a whole block, the allocation comes from what remains.
+		ASSERT_TRUE(lease.Allocate(1024, 8) != nullptr);
+	}
+
+	TEST_F(ConcurrentLinearAllocator_F, ThreadsGetDisjointMemory)
+	{
+		const unsigned num_threads = 4;
+		const unsigned num_allocs = 1000;
+		std::vector<void*> results[num_threads];
+
+		tests::RunOnThreads(num_threads, [this, &results](unsigned t)
+		{
+			ConcurrentLinearAllocator::Lease lease(*alloc, 4096);
+
+			for (unsigned i = 0; i < num_allocs; i++)
+			{
+				void *mem = (i % 2) ? lease.Allocate(24, 8) : alloc->Allocate(24, 8);
+				ASSERT_TRUE(mem != nullptr);
+				results[t].push_back(mem);
+			}
+		});
+
+		std::vector<uintptr_t> addresses;
+
+		for (std::vector<void*> &result : results)
+		{
+			for (void *mem : result)
+			{
+				addresses.push_back(reinterpret_cast<uintptr_t>(mem));
+			}
+		}
+
+		std::sort(addresses.begin(), addresses.end());
+
+		for (size_t i = 1; i < addresses.size(); i++)
+		{
+			ASSERT_GE(addresses[i] - addresses[i - 1], 24llu);
+		}
+	}
+}
+
+namespace testing_scratch
+{
+	// Returns results in (@param out), using its own scratch for temporaries.
+	int* SumPairs(Allocator *out, int const *values, size_t count)
+	{
+		alloc::Scratch scratch = alloc::GetScratch(out);
+		EXPECT_NE(out, scratch.GetAllocator());
+
+		int *temp = static_cast<int*>(scratch.Allocate(sizeof(int) * count, alignof(int)));
+		int *result = static_cast<int*>(out->Allocate(sizeof(int) * count / 2, alignof(int)));
+
+		for (size_t i = 0; i < count; i++)
+		{
+			temp[i] = values[i];
+		}
+
+		for (size_t i = 0; i < count / 2; i++)
+		{
+			result[i] = temp[2 * i] + temp[2 * i + 1];
+		}
+
+		return result;
+	}
+
+	TEST(ScratchTest, ScopeFreesAllocations)
+	{
+		alloc::Scratch outer = alloc::GetScratch();
+		const size_t used = outer.GetAllocator()->GetUsedMemory();
+
+		{
+			alloc::Scratch inner = alloc::GetScratch();
+			ASSERT_EQ(outer.GetAllocator(), inner.GetAllocator());
+			ASSERT_TRUE(inner.Allocate(1024, 8) != nullptr);
+		}
+
+		ASSERT_EQ(used, outer.GetAllocator()->GetUsedMemory());
+	}
+
+	TEST(ScratchTest, ConflictingArenaIsAvoided)
+	{
+		alloc::Scratch scratch = alloc::GetScratch();
+		const int values[] = { 1, 2, 3, 4 };
+
+		int *sums = SumPairs(scratch.GetAllocator(), values, 4);
+
+		ASSERT_EQ(3, sums[0]);
+		ASSERT_EQ(7, sums[1]);
+	}
+
+	TEST(ScratchTest, EveryArenaConflicting)
+	{
+		alloc::Scratch first = alloc::GetScratch();
+		alloc::Scratch second = alloc::GetScratch(first.GetAllocator());
+		ASSERT_NE(first.GetAllocator(), second.GetAllocator());
+
+		int *kept[2];
+		kept[0] = static_cast<int*>(first.Allocate(sizeof(int), alignof(int)));
+		kept[1] = static_cast<int*>(second.Allocate(sizeof(int), alignof(int)));
+		*kept[0] = 1;
+		*kept[1] = 2;
+
+		{
+			alloc::Scratch third = alloc::GetScratch(first.GetAllocator(), second.GetAllocator());
+			ASSERT_TRUE(third.OwnsArena());
+			ASSERT_NE(first.GetAllocator(), third.GetAllocator());
+			ASSERT_NE(second.GetAllocator(), third.GetAllocator());
+
+			int *temp = static_cast<int*>(third.Allocate(sizeof(int) * 64, alignof(int)));
+			ASSERT_TRUE(temp != nullptr);
+
+			for (unsigned i = 0; i < 64; i++)
+			{
+				temp[i] = -1;
+			}
+
+			// Moving keeps the arena alive.
+			alloc::Scratch moved(std::move(third));
+			ASSERT_TRUE(moved.OwnsArena());
+			ASSERT_FALSE(third.OwnsArena());
+		}
+
+		ASSERT_EQ(1, *kept[0]);
+		ASSERT_EQ(2, *kept[1]);
+	}
+}
+
+namespace testing_arena_pool
+{
+	TEST(ArenaPoolTest, ArenasAreRecycled)
+	{
+		ArenaPool pool;
+
+		LinearAllocator *arena = pool.Acquire(100 * 1024);
+		ASSERT_GE(arena->GetSize(), 100llu * 1024);
+		ASSERT_TRUE(arena->Allocate(1024, 8) != nullptr);
+
+		pool.Release(arena);
+		ASSERT_EQ(1llu, pool.GetNumIdleArenas());
+
+		LinearAllocator *reused = pool.Acquire(200 * 1024);
+		ASSERT_EQ(arena, reused);
+		ASSERT_EQ(0llu, reused->GetUsedMemory());
+
+		pool.Release(reused);
+	}
+
+	TEST(ArenaPoolTest, IdleArenasAreTrimmed)
+	{
+		const size_t max_idle_trims = 2;
+		ArenaPool pool(max_idle_trims);
+
+		pool.Release(pool.Acquire(1024));
+
+		for (size_t i = 0; i < max_idle_trims; i++)
+		{
+			pool.Trim();
+		}
+
+		ASSERT_EQ(1llu, pool.GetNumIdleArenas());
+
+		pool.Trim();
+		ASSERT_EQ(0llu, pool.GetNumIdleArenas());
+	}
+}
+
+namespace testing_static_dispatch
+{
+	// Allocator that isn't part of the Allocator hierarchy.
+	struct MallocAllocator
+	{
+		void* Allocate(size_t size, size_t alignment) { return malloc(size); }
+		void Deallocate(void *address) { free(address); }
+	};
+
+	static_assert(alloc::IsAllocator<Allocator>::value, "Allocator must satisfy the concept");
+	static_assert(alloc::IsAllocator<LinearAllocator>::value, "LinearAllocator must satisfy the concept");
+	static_assert(alloc::IsAllocator<MallocAllocator>::value, "MallocAllocator must satisfy the concept");
+	static_assert(!alloc::IsAllocator<int>::value, "int must not satisfy the concept");
+
+	TEST(StaticDispatchTest, UniquePointerOnConcreteType)
+	{
+		StackAllocator stack(1024);
+
+		alloc::unique_ptr<int, StackAllocator> integer = alloc::make_unique<int>(&stack, 5);
+		ASSERT_EQ(5, *integer);
+
+		// Converts to the type-erased form.
+		alloc::unique_ptr<int> erased = std::move(integer);
+		ASSERT_EQ(5, *erased);
+	}
+
+	TEST(StaticDispatchTest, VirtualAdapter)
+	{
+		MallocAllocator malloc_alloc;
+		alloc::VirtualAllocator<MallocAllocator> adapter(malloc_alloc);
+		Allocator *erased = &adapter;
+
+		int *integers = alloc::AllocateArray<int>(erased, 4);
+		ASSERT_EQ(1llu, erased->GetNumAllocations());
+
+		alloc::DeallocateArray(erased, integers);
+		ASSERT_EQ(0llu, erased->GetNumAllocations());
+	}
+}
+
+namespace testing_sources
+{
+	TEST(SourceTest, CallerBuffer)
+	{
+		char buffer[256];
+		LinearAllocator alloc(sizeof buffer, alloc::Source::FromBuffer(buffer));
+		ASSERT_EQ(static_cast<void*>(buffer), alloc.GetStart());
+
+		char *mem = static_cast<char*>(alloc.Allocate(128, 8));
+		ASSERT_TRUE(mem >= buffer && mem + 128 <= buffer + sizeof buffer);
+		ASSERT_TRUE(alloc.Allocate(256, 8) == nullptr);
+
+		alloc.Clear();
+	}
+
+	TEST(SourceTest, SubBlockOfParent)
+	{
+		FreeListAllocator parent(4096);
+
+		{
+			StackAllocator child(1024, alloc::Source::FromParent(parent));
+			ASSERT_EQ(1llu, parent.GetNumAllocations());
+			ASSERT_GE(parent.GetUsedMemory(), 1024llu);
+
+			void *mem = child.Allocate(512, 8);
+			ASSERT_TRUE(mem != nullptr);
+			child.Deallocate(mem);
+		}
+
+		ASSERT_EQ(0llu, parent.GetNumAllocations());
+	}
+
+	TEST(SourceTest, SubBlockOfSizedParent)
+	{
+		FreeListAllocator parent(4096, alloc::Source(), alloc::Frees::Sized);
+
+		{
+			StackAllocator child(1024, alloc::Source::FromParent(parent, 64));
+			ASSERT_EQ(0llu, reinterpret_cast<uintptr_t>(child.GetStart()) % 64);
+			ASSERT_EQ(1llu, parent.GetNumAllocations());
+		}
+
+		ASSERT_EQ(0llu, parent.GetNumAllocations());
+		ASSERT_EQ(0llu, parent.GetUsedMemory());
+	}
+
+	TEST(SourceTest, Mapped)
+	{
+		PoolAllocator alloc(1024 * 1024, 64, 8, alloc::Backing::Mapped);
+		ASSERT_EQ(1024llu * 1024, alloc.GetCommittedMemory());
+
+		void *mem = alloc.Allocate(64, 8);
+		ASSERT_TRUE(mem != nullptr);
+		alloc.Deallocate(mem);
+	}
+
+	TEST(SourceTest, ProxySharesMemory)
+	{
+		FreeListAllocator freelist(1024);
+		ProxyAllocator proxy(freelist);
+
+		ASSERT_EQ(freelist.GetStart(), proxy.GetStart());
+		ASSERT_EQ(alloc::Backing::Buffer, proxy.GetBacking());
+	}
+
+	TEST(SourceTest, HugePages)
+	{
+		const size_t size_8mb = 8 * 1024 * 1024;
+		LinearAllocator alloc(size_8mb, alloc::Backing::Huge);
+
+		char *mem = static_cast<char*>(alloc.Allocate(size_8mb, 8));
+		ASSERT_TRUE(mem != nullptr);
+		mem[0] = 1;
+		mem[size_8mb - 1] = 1;
+
+		// Whatever mode took effect, a huge page mapping starts on a huge page boundary.
+		if (alloc.GetPageMode() != alloc::vm::PageMode::Small)
+		{
+			ASSERT_EQ(0llu, reinterpret_cast<uintptr_t>(alloc.GetStart()) % alloc::vm::kHugePageSize);
+		}
+
+		alloc.Clear();
+	}
+
+	TEST(SourceTest, TransparentHugePagesFollowTheKernelSetting)
+	{
+		bool enabled = false;
+#if defined(__linux__)
+		if (FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r"))
+		{
+			char setting[64] = {};
+			const bool read = fgets(setting, sizeof(setting), file) != nullptr;
+			fclose(file);
+
+			enabled = read && (strstr(setting, "[always]") || strstr(setting, "[madvise]"));
+		}
+#endif
+		ASSERT_EQ(enabled, alloc::vm::TransparentHugePagesEnabled());
+
+		LinearAllocator alloc(alloc::vm::kHugePageSize, alloc::Backing::Huge);
+
+		// Explicit huge pages come first where some were set aside.
+		if (alloc.GetPageMode() != alloc::vm::PageMode::Huge)
+		{
+			ASSERT_EQ(enabled ? alloc::vm::PageMode::Transparent : alloc::vm::PageMode::Small, alloc.GetPageMode());
+		}
+	}
+}
+
+namespace testing_numa
+{
+	TEST(NumaTest, PlacedMemoryIsUsable)
+	{
+		const unsigned node = alloc::vm::CurrentNumaNode();
+		ASSERT_LT(node, alloc::vm::NumaNodeCount());
+
+		FreeListAllocator bound(1024 * 1024, alloc::Source::Placed(alloc::Backing::Mapped, alloc::vm::Numa::Bind, node));
+		FreeListAllocator interleaved(1024 * 1024, alloc::Source::Placed(alloc::Backing::Mapped, alloc::vm::Numa::Interleave));
+
+		void *mem = bound.Allocate(4096, 8);
+		void *mem2 = interleaved.Allocate(4096, 8);
+		ASSERT_TRUE(mem != nullptr && mem2 != nullptr);
+
+		bound.Deallocate(mem);
+		interleaved.Deallocate(mem2);
+	}
+
+	TEST(NumaTest, PrefaultKeepsContents)
+	{
+		LinearAllocator alloc(1024 * 1024, alloc::Source::Placed(alloc::Backing::Mapped, alloc::vm::Numa::FirstTouch));
+
+		int *integer = static_cast<int*>(alloc.Allocate(sizeof(int), alignof(int)));
+		*integer = 42;
+
+		alloc.Prefault();
+		ASSERT_EQ(42, *integer);
+
+		alloc.Clear();
+	}
+
+	TEST(NumaTest, RegistryRoutesToNode)
+	{
+		NumaAllocator numa([](unsigned node) -> Allocator*
+		{
+			return new FreeListAllocator(64 * 1024, alloc::Source::Placed(alloc::Backing::Mapped, alloc::vm::Numa::Bind, node));
+		});
+
+		ASSERT_EQ(alloc::vm::NumaNodeCount(), numa.GetNumNodes());
+
+		void *mem = numa.Allocate(128, 8);
+		ASSERT_TRUE(mem != nullptr);
+		ASSERT_EQ(1llu, numa.GetNodeAllocator(alloc::vm::CurrentNumaNode()).GetNumAllocations());
+
+		numa.Deallocate(mem);
+		ASSERT_EQ(0llu, numa.GetNodeAllocator(alloc::vm::CurrentNumaNode()).GetNumAllocations());
+	}
+}
+
+namespace testing_sized_frees
+{
+	TEST(SizedFreesTest, FreeListHasNoHeaders)
+	{
+		FreeListAllocator alloc(1024, alloc::Source(), alloc::Frees::Sized);
+
+		void *mem = alloc.Allocate(16, 8);
+		void *mem2 = alloc.Allocate(16, 8);
+
+		ASSERT_EQ(16llu, reinterpret_cast<uintptr_t>(mem2) - reinterpret_cast<uintptr_t>(mem));
+		ASSERT_EQ(32llu, alloc.GetUsedMemory());
+
+		alloc.Deallocate(mem, 16, 8);
+		alloc.Deallocate(mem2, 16, 8);
+
+		// Both blocks merged back, so the whole memory can be allocated again.
+		void *mem3 = alloc.Allocate(1024 - 16, 8);
+		ASSERT_TRUE(mem3 != nullptr);
+
+		alloc.Deallocate(mem3, 1024 - 16, 8);
+	}
+
+	TEST(SizedFreesTest, FreeListMergesWithPreviousBlock)
+	{
+		FreeListAllocator alloc(1024);
+
+		void *mem = alloc.Allocate(100, 8);
+		void *mem2 = alloc.Allocate(100, 8);
+		void *mem3 = alloc.Allocate(100, 8);
+
+		alloc.Deallocate(mem);
+		alloc.Deallocate(mem2);
+		alloc.Deallocate(mem3);
+
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+
+		void *mem4 = alloc.Allocate(900, 8);
+		ASSERT_TRUE(mem4 != nullptr);
+
+		alloc.Deallocate(mem4);
+	}
+
+	TEST(SizedFreesTest, StackFreesInReverse)
+	{
+		StackAllocator alloc(1024, alloc::Source(), alloc::Frees::Sized);
+
+		void *mem = alloc.Allocate(10, 4);
+		void *mem2 = alloc.Allocate(24, 8);
+		void *mem3 = alloc.Allocate(8, 64);
+
+		ASSERT_EQ(16, reinterpret_cast<uintptr_t>(mem2) - reinterpret_cast<uintptr_t>(mem));
+		ASSERT_EQ(0, reinterpret_cast<uintptr_t>(mem3) % 64);
+
+		alloc.Deallocate(mem3, 8, 64);
+		alloc.Deallocate(mem2, 24, 8);
+		alloc.Deallocate(mem, 10, 4);
+
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(SizedFreesTest, UniquePointerFreesSized)
+	{
+		FreeListAllocator alloc(1024, alloc::Source(), alloc::Frees::Sized);
+		{
+			auto integer = alloc::make_unique<int>(&alloc, 42);
+
+			ASSERT_EQ(42, *integer);
+		}
+
+		int *array = alloc::AllocateArray<int>(&alloc, 10);
+		alloc::DeallocateArray(&alloc, array);
+
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+}
+
+namespace testing_large_alignment
+{
+	TEST(LargeAlignmentTest, AdjustmentWithHeader)
+	{
+		void *mem_test = reinterpret_cast<void*>(0x1008);
+
+		ASSERT_EQ(0xff8llu, alloc::math::AdjustmentFromAlign(mem_test, 4096));
+		ASSERT_EQ(0xff8llu, alloc::math::AdjustmentFromAlignWithHeader(mem_test, 4096, 16));
+		ASSERT_EQ(0x1004llu, alloc::math::AdjustmentFromAlignWithHeader(reinterpret_cast<void*>(0x1ffc), 4096, 16));
+	}
+
+	TEST(LargeAlignmentTest, FreeListPageAligned)
+	{
+		FreeListAllocator alloc(64 * 1024);
+
+		void *small = alloc.Allocate(8, 8);
+		void *page = alloc.Allocate(100, 4096);
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, page, 4096);
+
+		alloc.Deallocate(page);
+		alloc.Deallocate(small);
+
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+
+		void *whole = alloc.Allocate(60 * 1024, 8);
+		ASSERT_TRUE(whole != nullptr);
+
+		alloc.Deallocate(whole);
+	}
+
+	TEST(LargeAlignmentTest, StackPageAligned)
+	{
+		StackAllocator alloc(64 * 1024);
+
+		void *small = alloc.Allocate(8, 8);
+		void *page = alloc.Allocate(100, 4096);
+		void *line = alloc.Allocate(8, 64);
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, page, 4096);
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, line, 64);
+
+		alloc.Deallocate(line);
+		alloc.Deallocate(page);
+		alloc.Deallocate(small);
+
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(LargeAlignmentTest, LinearHugePageAligned)
+	{
+		const size_t huge_page = 2 * 1024 * 1024;
+		LinearAllocator alloc(8 * huge_page, alloc::Backing::Virtual);
+
+		alloc.Allocate(8, 8);
+		void *mem = alloc.Allocate(huge_page, huge_page);
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, mem, huge_page);
+
+		alloc.Clear();
+	}
+}
+
+namespace testing_allocate_at_least
+{
+	TEST(AllocateAtLeastTest, FreeListReturnsWholeBlock)
+	{
+		FreeListAllocator alloc(1024);
+
+		void *first = alloc.Allocate(128, 8);
+		void *second = alloc.Allocate(128, 8);
+		alloc.Deallocate(first);
+
+		// The freed block has 8 bytes to spare, too few to split off a new block.
+		alloc::Allocation allocation = alloc.AllocateAtLeast(120, 8);
+		ASSERT_EQ(first, allocation.pointer);
+		ASSERT_EQ(128llu, allocation.size);
+
+		alloc.Deallocate(allocation.pointer);
+		alloc.Deallocate(second);
+	}
+
+	TEST(AllocateAtLeastTest, PoolReturnsWholeObject)
+	{
+		PoolAllocator alloc(1024, 64, 16);
+
+		alloc::Allocation allocation = alloc.AllocateAtLeast(40, 8);
+		ASSERT_TRUE(allocation.pointer != nullptr);
+		ASSERT_EQ(64llu, allocation.size);
+
+		alloc.Deallocate(allocation.pointer, allocation.size, 16);
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(AllocateAtLeastTest, ThroughBaseAndAdapter)
+	{
+		StackAllocator stack(1024, alloc::Source(), alloc::Frees::Sized);
+		alloc::VirtualAllocator<StackAllocator> adapter(stack);
+		Allocator &base = adapter;
+
+		alloc::Allocation allocation = base.AllocateAtLeast(10, 8);
+		ASSERT_EQ(16llu, allocation.size);
+
+		base.Deallocate(allocation.pointer, allocation.size, 8);
+		ASSERT_EQ(0llu, stack.GetUsedMemory());
+	}
+}
+
+namespace testing_reallocate
+{
+	TEST(ReallocateTest, LinearGrowsTopInPlace)
+	{
+		LinearAllocator alloc(1024);
+
+		alloc.Allocate(16, 8);
+		char *mem = static_cast<char*>(alloc.Allocate(16, 8));
+		mem[15] = 'x';
+
+		ASSERT_EQ(mem, alloc.Reallocate(mem, 16, 512, 8));
+		ASSERT_EQ('x', mem[15]);
+		ASSERT_EQ(nullptr, alloc.Reallocate(mem, 512, 2048, 8));
+
+		alloc.Clear();
+	}
+
+	TEST(ReallocateTest, StackResizesTop)
+	{
+		StackAllocator alloc(1024, alloc::Source(), alloc::Frees::Sized);
+
+		void *mem = alloc.Allocate(16, 8);
+		ASSERT_EQ(mem, alloc.Reallocate(mem, 16, 100, 8));
+		ASSERT_EQ(112llu, alloc.GetUsedMemory());
+
+		void *mem2 = alloc.Allocate(8, 8);
+		alloc.Deallocate(mem2, 8, 8);
+
+		alloc.Deallocate(mem, 100, 8);
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(ReallocateTest, StackOnlyShrinksBelowTop)
+	{
+		StackAllocator alloc(1024);
+
+		void *mem = alloc.Allocate(16, 8);
+		void *mem2 = alloc.Allocate(8, 8);
+
+		ASSERT_EQ(nullptr, alloc.Reallocate(mem, 16, 100, 8));
+		ASSERT_EQ(mem, alloc.Reallocate(mem, 16, 8, 8));
+
+		alloc.Deallocate(mem2);
+		alloc.Deallocate(mem);
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(ReallocateTest, FreeListMergesWithNeighbour)
+	{
+		FreeListAllocator alloc(4096);
+
+		int *mem = static_cast<int*>(alloc.Allocate(64, 8));
+		void *neighbour = alloc.Allocate(64, 8);
+		void *fence = alloc.Allocate(64, 8);
+		mem[0] = 42;
+
+		alloc.Deallocate(neighbour);
+
+		ASSERT_EQ(mem, alloc.Reallocate(mem, 64, 128, 8));
+		ASSERT_EQ(42, mem[0]);
+
+		// No room left before the fence, so it has to move.
+		int *moved = static_cast<int*>(alloc.Reallocate(mem, 128, 256, 8));
+		ASSERT_NE(mem, moved);
+		ASSERT_EQ(42, moved[0]);
+
+		// Shrinking gives the tail back.
+		ASSERT_EQ(moved, alloc.Reallocate(moved, 256, 32, 8));
+
+		alloc.Deallocate(moved);
+		alloc.Deallocate(fence);
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+
+		void *whole = alloc.Allocate(4000, 8);
+		ASSERT_TRUE(whole != nullptr);
+		alloc.Deallocate(whole);
+	}
+
+	TEST(ReallocateTest, PoolKeepsObject)
+	{
+		PoolAllocator alloc(1024, 64, 8);
+
+		void *mem = alloc.Allocate(64, 8);
+		ASSERT_EQ(mem, alloc.Reallocate(mem, 32, 64, 8));
+		ASSERT_EQ(nullptr, alloc.Reallocate(mem, 64, 65, 8));
+
+		alloc.Deallocate(mem);
+	}
+}
+
+namespace testing_composition
+{
+	TEST(CompositionTest, OwnsIsRangeCheck)
+	{
+		FreeListAllocator alloc(1024);
+		FreeListAllocator other(1024);
+
+		void *mem = alloc.Allocate(16, 8);
+		ASSERT_TRUE(alloc.Owns(mem));
+		ASSERT_FALSE(other.Owns(mem));
+		ASSERT_FALSE(alloc.Owns(alloc::math::Add(alloc.GetStart(), alloc.GetSize())));
+
+		alloc.Deallocate(mem);
+	}
+
+	TEST(CompositionTest, FallbackWhenPrimaryIsFull)
+	{
+		StackAllocator stack(256);
+		FreeListAllocator free_list(4096);
+		alloc::FallbackAllocator<StackAllocator, FreeListAllocator> fallback(stack, free_list);
+
+		void *mem = fallback.Allocate(128, 8);
+		void *mem2 = fallback.Allocate(128, 8);
+
+		ASSERT_TRUE(stack.Owns(mem));
+		ASSERT_TRUE(free_list.Owns(mem2));
+		ASSERT_TRUE(fallback.Owns(mem) && fallback.Owns(mem2));
+
+		fallback.Deallocate(mem2);
+		fallback.Deallocate(mem);
+
+		ASSERT_EQ(0llu, stack.GetUsedMemory());
+		ASSERT_EQ(0llu, free_list.GetUsedMemory());
+	}
+
+	TEST(CompositionTest, PoolsForSmallSizes)
+	{
+		typedef alloc::Bucketizer<PoolAllocator, 16, 64> Pools;
+
+		Pools pools([](size_t object_size) { return new PoolAllocator(4096, object_size, 16); });
+		FreeListAllocator free_list(4096);
+		alloc::Segregator<64, Pools, FreeListAllocator> segregator(pools, free_list);
+
+		void *small = segregator.Allocate(24, 8);
+		void *large = segregator.Allocate(200, 8);
+
+		ASSERT_TRUE(pools.GetBucket(1).Owns(small));
+		ASSERT_TRUE(free_list.Owns(large));
+
+		// Type erased, with the calls inside still bound statically.
+		alloc::VirtualAllocator<alloc::Segregator<64, Pools, FreeListAllocator>> adapter(segregator);
+		Allocator &base = adapter;
+
+		void *mem = base.Allocate(32, 8);
+		ASSERT_TRUE(pools.GetBucket(1).Owns(mem));
+		ASSERT_TRUE(base.Owns(mem));
+		base.Deallocate(mem, 32, 8);
+
+		segregator.Deallocate(small, 24, 8);
+		segregator.Deallocate(large);
+
+		ASSERT_EQ(0llu, pools.GetBucket(1).GetUsedMemory());
+		ASSERT_EQ(0llu, free_list.GetUsedMemory());
+	}
+}
+
+namespace testing_memory_resource
+{
+	TEST(MemoryResourceTest, VectorOnFreeList)
+	{
+		FreeListAllocator alloc(64 * 1024);
+		alloc::MemoryResource<FreeListAllocator> resource(alloc);
+		{
+			std::pmr::vector<int> vector(&resource);
+
+			for (int i = 0; i < 1000; i++)
+			{
+				vector.push_back(i);
+			}
+
+			ASSERT_TRUE(alloc.Owns(vector.data()));
+			ASSERT_EQ(999, vector.back());
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(MemoryResourceTest, OutOfMemoryThrows)
+	{
+		LinearAllocator alloc(1024);
+		alloc::MemoryResource<> resource(alloc);
+
+		ASSERT_THROW((void)resource.allocate(4096, 8), std::bad_alloc);
+
+		alloc::LinearResource linear(1024, alloc::Source(), std::pmr::null_memory_resource());
+
+		ASSERT_TRUE(linear.allocate(512, 64) != nullptr);
+		ASSERT_THROW((void)linear.allocate(4096, 8), std::bad_alloc);
+
+		linear.Clear();
+	}
+
+	TEST(MemoryResourceTest, LinearOverflowsToUpstream)
+	{
+		alloc::LinearResource linear(1024);
+
+		void *mem = linear.allocate(512, 8);
+		void *mem2 = linear.allocate(1024, 8);
+
+		ASSERT_TRUE(linear.GetArena().Owns(mem));
+		ASSERT_FALSE(linear.GetArena().Owns(mem2));
+
+		linear.deallocate(mem2, 1024, 8);
+		linear.deallocate(mem, 512, 8);
+	}
+
+	// Counts what's outstanding, over the new/delete resource.
+	struct CountingResource : std::pmr::memory_resource
+	{
+		size_t allocations = 0;
+
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			allocations++;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void *address, size_t bytes, size_t alignment) override
+		{
+			allocations--;
+			std::pmr::new_delete_resource()->deallocate(address, bytes, alignment);
+		}
+
+		bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+	};
+
+	TEST(MemoryResourceTest, UnorderedMapNodesFromPool)
+	{
+		CountingResource upstream;
+		alloc::PoolResource pool(64 * 1024, 64, 16, alloc::Source(), &upstream);
+		{
+			std::pmr::unordered_map<int, int> map(&pool);
+			// Some implementations allocate a sentinel node upfront.
+			const size_t nodes = pool.GetPool().GetNumAllocations();
+
+			for (int i = 0; i < 100; i++)
+			{
+				map[i] = i * 2;
+			}
+
+			ASSERT_EQ(198, map[99]);
+			// A node per element from the pool, only the bucket array goes upstream.
+			ASSERT_EQ(nodes + 100, pool.GetPool().GetNumAllocations());
+			ASSERT_LE(upstream.allocations, 2llu);
+		}
+
+		ASSERT_EQ(0llu, pool.GetPool().GetNumAllocations());
+		ASSERT_EQ(0llu, upstream.allocations);
+	}
+}
+
+namespace testing_stl_allocator
+{
+	TEST(StlAllocatorTest, MapNodesComeFromPools)
+	{
+		FreeListAllocator alloc(1024 * 1024);
+		alloc::NodePools pools(alloc, 4096);
+		{
+			typedef alloc::StlAllocator<std::pair<const int, int>> MapAllocator;
+			std::map<int, int, std::less<int>, MapAllocator> map(MapAllocator(alloc, &pools));
+
+			for (int i = 0; i < 1000; i++)
+			{
+				map[i] = i;
+			}
+
+			ASSERT_EQ(999, map[999]);
+
+			// Nodes come from pool chunks, which are all the free list holds.
+			ASSERT_LT(alloc.GetNumAllocations(), 100llu);
+		}
+	}
+
+	TEST(StlAllocatorTest, ArraysBypassPools)
+	{
+		FreeListAllocator alloc(1024 * 1024);
+		alloc::NodePools pools(alloc);
+		{
+			std::vector<int, alloc::StlAllocator<int>> vector(alloc::StlAllocator<int>(alloc, &pools));
+			vector.resize(100);
+
+			ASSERT_TRUE(alloc.Owns(vector.data()));
+			ASSERT_FALSE(pools.GetPool(sizeof(int), alignof(int)).Owns(vector.data()));
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(StlAllocatorTest, SingleElementArraysBypassPools)
+	{
+		FreeListAllocator alloc(1024 * 1024);
+		alloc::NodePools pools(alloc);
+		{
+			std::vector<double, alloc::StlAllocator<double>> vector(alloc::StlAllocator<double>(alloc, &pools));
+			vector.reserve(1);
+			vector.push_back(1.0);
+
+			ASSERT_FALSE(pools.GetPool(sizeof(double), alignof(double)).Owns(vector.data()));
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(StlAllocatorTest, ListWithoutPools)
+	{
+		StackAllocator alloc(64 * 1024);
+		{
+			std::list<int, alloc::StlAllocator<int>> list{ alloc::StlAllocator<int>(alloc) };
+			// Some implementations allocate a sentinel node upfront.
+			const size_t nodes = alloc.GetNumAllocations();
+
+			list.push_back(1);
+			list.push_back(2);
+
+			ASSERT_EQ(nodes + 2, alloc.GetNumAllocations());
+
+			list.pop_back();
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+}
+
+namespace testing_locked_alloc
+{
+	template<class Lock>
+	void AllocateFromThreads()
+	{
+		FreeListAllocator alloc(4 * 1024 * 1024);
+		alloc::LockedAllocator<FreeListAllocator, Lock> locked(alloc);
+
+		tests::RunOnThreads(4, [&locked](unsigned t)
+		{
+			for (unsigned i = 0; i < 1000; i++)
+			{
+				void *mem = locked.Allocate(64, 8);
+				ASSERT_TRUE(tests::WriteAndCheck(mem, t));
+				locked.Deallocate(mem, 64, 8);
+			}
+		});
+
+		// Every call took the lock once, however the threads interleaved.
+		const alloc::LockStats stats = locked.GetStats();
+
+		ASSERT_EQ(8000llu, stats.acquisitions);
+		ASSERT_LE(stats.contended, stats.acquisitions);
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(LockedAllocatorTest, CountsUncontended)
+	{
+		StackAllocator alloc(1024);
+		alloc::LockedAllocator<StackAllocator> locked(alloc);
+
+		void *mem = locked.Allocate(16, 8);
+		ASSERT_TRUE(locked.Owns(mem));
+		locked.Deallocate(mem);
+
+		const alloc::LockStats stats = locked.GetStats();
+
+		ASSERT_EQ(2llu, stats.acquisitions);
+		ASSERT_EQ(0llu, stats.contended);
+		ASSERT_EQ(0llu, stats.wait_ns);
+	}
+
+	TEST(LockedAllocatorTest, Mutex) { AllocateFromThreads<std::mutex>(); }
+	TEST(LockedAllocatorTest, TicketLock) { AllocateFromThreads<alloc::TicketLock>(); }
+	TEST(LockedAllocatorTest, AdaptiveLock) { AllocateFromThreads<alloc::AdaptiveLock>(); }
+}
+
+namespace testing_sharded_alloc
+{
+	TEST(ShardedAllocatorTest, SplitsIntoShards)
+	{
+		ShardedAllocator alloc(4 * 4096, 4, alloc::ShardBy::RoundRobin);
+
+		ASSERT_EQ(4u, alloc.GetNumShards());
+
+		for (unsigned i = 0; i < 4; i++)
+		{
+			ASSERT_EQ(4096llu, alloc.GetShard(i).GetSize());
+			ASSERT_EQ(alloc::math::Add(alloc.GetStart(), i * 4096), alloc.GetShard(i).GetStart());
+		}
+	}
+
+	TEST(ShardedAllocatorTest, FallsBackToOtherShards)
+	{
+		ShardedAllocator alloc(4 * 4096, 4, alloc::ShardBy::Cpu);
+		std::vector<void*> mems;
+
+		// More than a shard holds.
+		for (unsigned i = 0; i < 8; i++)
+		{
+			void *mem = alloc.Allocate(1024, 8);
+			ASSERT_NE(nullptr, mem);
+			ASSERT_TRUE(alloc.Owns(mem));
+			mems.push_back(mem);
+		}
+
+		ASSERT_EQ(8llu, alloc.GetNumAllocations());
+
+		for (void *mem : mems)
+		{
+			alloc.Deallocate(mem);
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(ShardedAllocatorTest, StatisticsThroughBaseAndProxy)
+	{
+		ShardedAllocator alloc(4 * 4096, 4, alloc::ShardBy::RoundRobin);
+		ProxyAllocator proxy(alloc);
+		Allocator &base = alloc;
+
+		void *mem = proxy.Allocate(100, 8);
+		ASSERT_NE(nullptr, mem);
+
+		ASSERT_EQ(1llu, base.GetNumAllocations());
+		ASSERT_GE(base.GetUsedMemory(), 100llu);
+		ASSERT_EQ(base.GetUsedMemory(), proxy.GetUsedMemory());
+
+		proxy.Deallocate(mem);
+
+		ASSERT_EQ(0llu, base.GetUsedMemory());
+		ASSERT_EQ(0llu, proxy.GetUsedMemory());
+	}
+
+	TEST(ShardedAllocatorTest, FreesFromOtherThreads)
+	{
+		ShardedAllocator alloc(1024 * 1024, 4, alloc::ShardBy::RoundRobin);
+		std::vector<void*> mems;
+
+		for (unsigned i = 0; i < 100; i++)
+		{
+			mems.push_back(alloc.Allocate(64, 8));
+		}
+
+		std::thread([&alloc, &mems]()
+		{
+			for (void *mem : mems)
+			{
+				alloc.Deallocate(mem, 64, 8);
+			}
+		}).join();
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(ShardedAllocatorTest, StatisticsWhileAllocating)
+	{
+		ShardedAllocator alloc(1024 * 1024, 2);
+		std::atomic<bool> done(false);
+
+		tests::RunOnThreads(3, [&alloc, &done](unsigned t)
+		{
+			if (t == 0)
+			{
+				while (!done.load())
+				{
+					ASSERT_LE(alloc.GetNumAllocations(), 2llu);
+					ASSERT_LE(alloc.GetUsedMemory(), alloc.GetSize());
+				}
+
+				return;
+			}
+
+			for (unsigned i = 0; i < 1000; i++)
+			{
+				alloc.Deallocate(alloc.Allocate(64, 8));
+			}
+
+			if (t == 2)
+			{
+				done.store(true);
+			}
+		});
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+
+	TEST(ShardedAllocatorTest, AllocateFromThreads)
+	{
+		ShardedAllocator alloc(4 * 1024 * 1024, 4, alloc::ShardBy::RoundRobin);
+		void *kept[4];
+
+		tests::RunOnThreads(4, [&alloc, &kept](unsigned t)
+		{
+			for (unsigned i = 0; i < 1000; i++)
+			{
+				void *mem = alloc.Reallocate(nullptr, 0, 32, 8);
+				ASSERT_TRUE(tests::WriteAndCheck(mem, t));
+				mem = alloc.Reallocate(mem, 32, 128, 8);
+				ASSERT_EQ(t, *static_cast<unsigned*>(mem));
+				alloc.Deallocate(mem);
+			}
+
+			kept[t] = alloc.Allocate(64, 8);
+		});
+
+		// Four new threads got four consecutive shards, none had to spill over.
+		for (unsigned i = 0; i < 4; i++)
+		{
+			ASSERT_EQ(1llu, alloc.GetShard(i).GetNumAllocations());
+		}
+
+		// Freed on another thread, back to the shards they came from.
+		for (void *mem : kept)
+		{
+			alloc.Deallocate(mem);
+		}
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+	}
+}
+
+namespace testing_remote_free
+{
+	TEST(RemoteFreeAllocatorTest, OwnerFreesDirectly)
+	{
+		PoolAllocator pool(1024, 16, 8);
+		alloc::RemoteFreeAllocator<PoolAllocator> remote(pool);
+
+		void *mem = remote.Allocate(16, 8);
+		ASSERT_EQ(1llu, pool.GetNumAllocations());
+
+		remote.Deallocate(mem);
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+		ASSERT_EQ(0llu, remote.GetNumRemoteFrees());
+	}
+
+	TEST(RemoteFreeAllocatorTest, AlignsForTheLink)
+	{
+		LinearAllocator linear(1024);
+		alloc::RemoteFreeAllocator<LinearAllocator> remote(linear);
+
+		linear.Allocate(1, 1);
+		void *mem = remote.Allocate(2);
+
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, mem, alignof(void*));
+
+		linear.Clear();
+	}
+
+	TEST(RemoteFreeAllocatorTest, CollectsOnNextAllocate)
+	{
+		FreeListAllocator freelist(64 * 1024);
+		alloc::RemoteFreeAllocator<FreeListAllocator> remote(freelist);
+		std::vector<void*> mems;
+
+		for (unsigned i = 0; i < 100; i++)
+		{
+			mems.push_back(remote.Allocate(2, 8));
+		}
+
+		std::thread([&remote, &mems]()
+		{
+			for (void *mem : mems)
+			{
+				remote.Deallocate(mem, 2, 8);
+			}
+		}).join();
+
+		// Queued, not freed yet.
+		ASSERT_EQ(100llu, freelist.GetNumAllocations());
+
+		void *mem = remote.Allocate(16, 8);
+
+		ASSERT_EQ(1llu, freelist.GetNumAllocations());
+		ASSERT_EQ(100llu, remote.GetNumRemoteFrees());
+
+		remote.Deallocate(mem);
+	}
+
+	TEST(RemoteFreeAllocatorTest, ProducerConsumer)
+	{
+		PoolAllocator pool(64 * 1024, 64, 8);
+		alloc::RemoteFreeAllocator<PoolAllocator> remote(pool);
+		std::atomic<void*> slot(nullptr);
+		const unsigned count = 10000;
+
+		std::thread consumer([&remote, &slot]()
+		{
+			for (unsigned i = 0; i < count; i++)
+			{
+				void *mem;
+
+				while (!(mem = slot.exchange(nullptr, std::memory_order_acquire)))
+				{
+					std::this_thread::yield();
+				}
+
+				remote.Deallocate(mem);
+			}
+		});
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			void *mem;
+
+			while (!(mem = remote.Allocate(64, 8)))
+			{
+				std::this_thread::yield();
+			}
+
+			while (slot.load(std::memory_order_relaxed))
+			{
+				std::this_thread::yield();
+			}
+
+			slot.store(mem, std::memory_order_release);
+		}
+
+		consumer.join();
+		remote.Collect();
+
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+		ASSERT_EQ(count, remote.GetNumRemoteFrees());
+	}
+}
+
+namespace testing_per_cpu_cache
+{
+	const alloc::SlotBy kSlotBys[] = { alloc::SlotBy::Rseq, alloc::SlotBy::Cpu, alloc::SlotBy::Thread };
+
+	// Keeps the test on one CPU, so it sees a single slot with every SlotBy, the others get one slot to begin with.
+	struct StayOnOneCpu
+	{
+#ifdef ALLOC_RSEQ
+		StayOnOneCpu()
+		{
+			cpu_set_t cpu;
+			CPU_ZERO(&cpu);
+			CPU_SET(sched_getcpu(), &cpu);
+
+			sched_getaffinity(0, sizeof(cpu_set_t), &previous);
+			sched_setaffinity(0, sizeof(cpu_set_t), &cpu);
+		}
+
+		~StayOnOneCpu()
+		{
+			sched_setaffinity(0, sizeof(cpu_set_t), &previous);
+		}
+
+		cpu_set_t previous;
+#endif
+	};
+
+	unsigned SlotsFor(alloc::SlotBy slot_by)
+	{
+		return slot_by == alloc::SlotBy::Rseq ? 0 : 1;
+	}
+
+	TEST(PerCpuCacheTest, PicksTheFastestAvailable)
+	{
+		PoolAllocator pool(64 * 1024, 32, 8);
+
+		alloc::PerCpuCache<PoolAllocator> by_thread(pool, 32, 8, 16, 1, alloc::SlotBy::Thread);
+		ASSERT_EQ(alloc::SlotBy::Thread, by_thread.GetSlotBy());
+
+		alloc::PerCpuCache<PoolAllocator> by_cpu(pool, 32, 8, 16, 1, alloc::SlotBy::Cpu);
+		ASSERT_EQ(alloc::vm::CurrentCpuSupported() ? alloc::SlotBy::Cpu : alloc::SlotBy::Thread, by_cpu.GetSlotBy());
+
+		alloc::PerCpuCache<PoolAllocator> fastest(pool, 32, 8, 16);
+#ifdef ALLOC_RSEQ
+		if (alloc::rseq::Registered())
+		{
+			ASSERT_EQ(alloc::SlotBy::Rseq, fastest.GetSlotBy());
+			ASSERT_GE(fastest.GetNumSlots(), alloc::rseq::NumCpus());
+			return;
+		}
+#endif
+		ASSERT_NE(alloc::SlotBy::Rseq, fastest.GetSlotBy());
+	}
+
+	TEST(PerCpuCacheTest, RefillsHalfASlot)
+	{
+		for (alloc::SlotBy slot_by : kSlotBys)
+		{
+			StayOnOneCpu stay;
+			PoolAllocator pool(64 * 1024, 32, 8);
+			alloc::PerCpuCache<PoolAllocator> cache(pool, 32, 8, 16, SlotsFor(slot_by), slot_by);
+
+			void *mem = cache.Allocate(32, 8);
+			ASSERT_NE(nullptr, mem);
+			ASSERT_EQ(8llu, pool.GetNumAllocations());
+			ASSERT_EQ(7llu, cache.GetCachedObjects());
+
+			// Last in, first out.
+			cache.Deallocate(mem);
+			ASSERT_EQ(mem, cache.Allocate(24, 8));
+			cache.Deallocate(mem, 24, 8);
+
+			cache.Flush();
+			ASSERT_EQ(0llu, pool.GetNumAllocations());
+			ASSERT_EQ(0llu, cache.GetCachedObjects());
+		}
+	}
+
+	TEST(PerCpuCacheTest, FlushesHalfWhenFull)
+	{
+		for (alloc::SlotBy slot_by : kSlotBys)
+		{
+			StayOnOneCpu stay;
+			PoolAllocator pool(64 * 1024, 32, 8);
+			alloc::PerCpuCache<PoolAllocator> cache(pool, 32, 8, 16, SlotsFor(slot_by), slot_by);
+			std::vector<void*> mems;
+
+			for (unsigned i = 0; i < 40; i++)
+			{
+				mems.push_back(cache.Allocate(32, 8));
+			}
+
+			for (void *mem : mems)
+			{
+				cache.Deallocate(mem);
+				ASSERT_LE(cache.GetCachedObjects(), 16llu * cache.GetNumSlots());
+			}
+
+			ASSERT_EQ(pool.GetNumAllocations(), cache.GetCachedObjects());
+		}
+	}
+
+	TEST(PerCpuCacheTest, RunsOutWithThePool)
+	{
+		for (alloc::SlotBy slot_by : kSlotBys)
+		{
+			StayOnOneCpu stay;
+			PoolAllocator pool(4 * 32, 32, 8);
+			alloc::PerCpuCache<PoolAllocator> cache(pool, 32, 8, 16, SlotsFor(slot_by), slot_by);
+
+			void *mems[4];
+
+			for (unsigned i = 0; i < 4; i++)
+			{
+				mems[i] = cache.Allocate(32, 8);
+				ASSERT_NE(nullptr, mems[i]);
+			}
+
+			ASSERT_EQ(nullptr, cache.Allocate(32, 8));
+
+			for (void *mem : mems)
+			{
+				cache.Deallocate(mem);
+			}
+		}
+	}
+
+	TEST(PerCpuCacheTest, AllocateFromThreads)
+	{
+		for (alloc::SlotBy slot_by : kSlotBys)
+		{
+			PoolAllocator pool(1024 * 1024, 64, 8);
+			alloc::PerCpuCache<PoolAllocator> cache(pool, 64, 8, 32, 0, slot_by);
+
+			tests::RunOnThreads(4, [&cache](unsigned t)
+			{
+				for (unsigned i = 0; i < 1000; i++)
+				{
+					void *mem = cache.Allocate(64, 8);
+					ASSERT_TRUE(tests::WriteAndCheck(mem, t));
+					cache.Deallocate(mem);
+				}
+			});
+
+			// Everything freed is either in a slot or back in the pool, and no slot grew past its capacity.
+			ASSERT_EQ(pool.GetNumAllocations(), cache.GetCachedObjects());
+			ASSERT_LE(cache.GetCachedObjects(), 32llu * cache.GetNumSlots());
+
+			cache.Flush();
+			ASSERT_EQ(0llu, pool.GetNumAllocations());
+		}
+	}
+}
+
+namespace testing_epoch_alloc
+{
+	typedef alloc::EpochAllocator<PoolAllocator> Epochs;
+
+	TEST(EpochAllocatorTest, FreesThreeEpochsLater)
+	{
+		PoolAllocator pool(64 * 1024, 16, 8);
+		Epochs epochs(pool);
+		Epochs::Participant &me = epochs.Join();
+
+		me.Enter();
+		me.Retire(epochs.Allocate(16, 8));
+		me.Exit();
+
+		ASSERT_EQ(1llu, pool.GetNumAllocations());
+
+		// Nobody else is inside, every attempt moves the epoch.
+		for (unsigned i = 0; i < 2; i++)
+		{
+			ASSERT_TRUE(epochs.TryAdvance());
+			Epochs::Guard guard(me);
+			ASSERT_EQ(1llu, pool.GetNumAllocations());
+		}
+
+		ASSERT_TRUE(epochs.TryAdvance());
+		{
+			Epochs::Guard guard(me);
+		}
+
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+		ASSERT_EQ(1llu, me.GetNumRetired());
+		ASSERT_EQ(1llu, me.GetNumReclaimed());
+	}
+
+	TEST(EpochAllocatorTest, ThreadInsideHoldsTheEpoch)
+	{
+		PoolAllocator pool(64 * 1024, 16, 8);
+		Epochs epochs(pool);
+		Epochs::Participant &me = epochs.Join();
+		Epochs::Participant &other = epochs.Join();
+
+		other.Enter();
+
+		ASSERT_TRUE(epochs.TryAdvance());
+		// Other is still in the previous epoch.
+		ASSERT_FALSE(epochs.TryAdvance());
+
+		other.Exit();
+		ASSERT_TRUE(epochs.TryAdvance());
+
+		Epochs::Guard guard(me);
+	}
+
+	// The epoch moves on between reading it and publishing it, nothing held it back then.
+	TEST(EpochAllocatorTest, EnterPublishesTheCurrentEpoch)
+	{
+		PoolAllocator pool(64 * 1024, 16, 8);
+		Epochs epochs(pool);
+		Epochs::Participant &me = epochs.Join();
+		Epochs::Participant &other = epochs.Join();
+
+		const unsigned seen = epochs.GetEpoch();
+
+		ASSERT_TRUE(epochs.TryAdvance());
+		ASSERT_TRUE(epochs.TryAdvance());
+
+		me.Enter(seen);
+		ASSERT_EQ(epochs.GetEpoch(), me.GetEpoch());
+
+		me.Retire(epochs.Allocate(16, 8));
+		me.Exit();
+
+		// Other may still read the node, retired in the epoch it's in.
+		other.Enter();
+		ASSERT_TRUE(epochs.TryAdvance());
+
+		me.Enter();
+		ASSERT_EQ(1llu, pool.GetNumAllocations());
+		me.Exit();
+
+		other.Exit();
+	}
+
+	// Treiber stack, popped nodes are retired while other threads may still read them.
+	TEST(EpochAllocatorTest, LockFreeStack)
+	{
+		struct StackNode
+		{
+			StackNode *next;
+			unsigned value;
+		};
+
+		PoolAllocator pool(1024 * 1024, sizeof(StackNode), alignof(StackNode));
+		Epochs epochs(pool);
+		std::atomic<StackNode*> top(nullptr);
+
+		tests::RunOnThreads(4, [&epochs, &top](unsigned t)
+		{
+			Epochs::Participant &me = epochs.Join();
+
+			for (unsigned i = 0; i < 5000; i++)
+			{
+				Epochs::Guard guard(me);
+
+				StackNode *node = new(epochs.Allocate(sizeof(StackNode), alignof(StackNode))) StackNode;
+				node->value = t;
+				node->next = top.load();
+
+				while (!top.compare_exchange_weak(node->next, node))
+				{
+				}
+
+				StackNode *popped = top.load();
+
+				while (popped && !top.compare_exchange_weak(popped, popped->next))
+				{
+				}
+
+				if (popped)
+				{
+					ASSERT_LT(popped->value, 4u);
+					me.Retire(popped);
+				}
+			}
+		});
+
+		ASSERT_EQ(nullptr, top.load());
+	}
+}
+
+namespace testing_deferred_free
+{
+	TEST(DeferredFreeAllocatorTest, FlushFreesEverything)
+	{
+		FreeListAllocator freelist(64 * 1024);
+		alloc::DeferredFreeAllocator<FreeListAllocator> deferred(freelist);
+		std::vector<void*> mems;
+
+		for (unsigned i = 0; i < 100; i++)
+		{
+			mems.push_back(deferred.Allocate(2 + i, 8));
+		}
+
+		for (void *mem : mems)
+		{
+			deferred.Deallocate(mem);
+		}
+
+		deferred.Flush();
+
+		ASSERT_EQ(0llu, freelist.GetNumAllocations());
+		ASSERT_EQ(0llu, freelist.GetUsedMemory());
+		ASSERT_EQ(100llu, deferred.GetNumFreed());
+	}
+
+	TEST(DeferredFreeAllocatorTest, DestructorFreesWhatsQueued)
+	{
+		PoolAllocator pool(64 * 1024, 64, 8);
+		{
+			alloc::DeferredFreeAllocator<PoolAllocator> deferred(pool);
+
+			for (unsigned i = 0; i < 1000; i++)
+			{
+				deferred.Deallocate(deferred.Allocate(64, 8), 64, 8);
+			}
+		}
+
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+	}
+
+	// Counts its unlocks, what was done under it is visible once the count is read.
+	struct CountingLock
+	{
+		static std::atomic<unsigned> s_Unlocks;
+
+		std::mutex mutex;
+
+		void lock() { mutex.lock(); }
+		bool try_lock() { return mutex.try_lock(); }
+
+		void unlock()
+		{
+			s_Unlocks.fetch_add(1, std::memory_order_release);
+			mutex.unlock();
+		}
+	};
+
+	std::atomic<unsigned> CountingLock::s_Unlocks(0);
+
+	TEST(DeferredFreeAllocatorTest, FreesWithoutAFullBatch)
+	{
+		PoolAllocator pool(64 * 1024, 64, 8);
+		alloc::DeferredFreeAllocator<PoolAllocator, CountingLock> deferred(pool);
+
+		void *mem = deferred.Allocate(64, 8);
+		const unsigned unlocks = CountingLock::s_Unlocks.load(std::memory_order_acquire);
+
+		deferred.Deallocate(mem);
+
+		// The thread wakes up for the first free, not only once a batch is full.
+		for (unsigned i = 0; i < 1000 && CountingLock::s_Unlocks.load(std::memory_order_acquire) == unlocks; i++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+	}
+
+	TEST(DeferredFreeAllocatorTest, FailedAllocationFreesWhatsQueued)
+	{
+		PoolAllocator pool(16 * 64, 64, 8);
+		alloc::DeferredFreeAllocator<PoolAllocator> deferred(pool);
+		std::vector<void*> mems;
+
+		while (void *mem = deferred.Allocate(64, 8))
+		{
+			mems.push_back(mem);
+		}
+
+		for (void *mem : mems)
+		{
+			deferred.Deallocate(mem);
+		}
+
+		// Whether the thread got to them or not, the queued blocks can be allocated again right away.
+		for (void *&mem : mems)
+		{
+			mem = deferred.Allocate(64, 8);
+			ASSERT_NE(nullptr, mem);
+		}
+
+		ASSERT_EQ(mems.size(), pool.GetNumAllocations());
+
+		for (void *mem : mems)
+		{
+			deferred.Deallocate(mem);
+		}
+
+		deferred.Flush();
+		ASSERT_EQ(0llu, pool.GetNumAllocations());
+	}
+
+	TEST(DeferredFreeAllocatorTest, FreeFromThreads)
+	{
+		FreeListAllocator freelist(1024 * 1024);
+		alloc::DeferredFreeAllocator<FreeListAllocator> deferred(freelist);
+
+		tests::RunOnThreads(4, [&deferred](unsigned t)
+		{
+			for (unsigned i = 0; i < 2000; i++)
+			{
+				void *mem = deferred.Allocate(32, 8);
+				ASSERT_TRUE(tests::WriteAndCheck(mem, t));
+				deferred.Deallocate(mem);
+			}
+		});
+
+		deferred.Flush();
+
+		// Every free from every thread went through the queue exactly once.
+		ASSERT_EQ(0llu, freelist.GetNumAllocations());
+		ASSERT_EQ(8000llu, deferred.GetNumFreed());
+	}
+}
+
+namespace testing_concurrent_freelist
+{
+	TEST(ConcurrentFreeListAllocatorTest, AllocateAligned)
+	{
+		ConcurrentFreeListAllocator alloc(64 * 1024);
+
+		void *small = alloc.Allocate(3, 4);
+		void *aligned = alloc.Allocate(100, 256);
+
+		ASSERT_EQ(0llu, alloc::math::AdjustmentFromAlign(aligned, 256));
+		ASSERT_TRUE(alloc.Owns(small) && alloc.Owns(aligned));
+		ASSERT_EQ(2llu, alloc.GetNumAllocations());
+
+		alloc.Deallocate(aligned);
+		alloc.Deallocate(small);
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+		ASSERT_EQ(0llu, alloc.GetUsedMemory());
+	}
+
+	TEST(ConcurrentFreeListAllocatorTest, ConsolidatesWhenFragmented)
+	{
+		ConcurrentFreeListAllocator alloc(16 * 1024);
+		std::vector<void*> mems;
+
+		while (void *mem = alloc.Allocate(100, 8))
+		{
+			mems.push_back(mem);
+		}
+
+		// The allocation that failed tried merging first.
+		ASSERT_EQ(1llu, alloc.GetNumConsolidations());
+
+		for (void *mem : mems)
+		{
+			alloc.Deallocate(mem);
+		}
+
+		// Only small free blocks until they're merged.
+		void *big = alloc.Allocate(8 * 1024, 8);
+		ASSERT_NE(nullptr, big);
+		ASSERT_EQ(2llu, alloc.GetNumConsolidations());
+
+		alloc.Deallocate(big);
+
+		ASSERT_GE(alloc.Consolidate(), 16 * 1024 - 64llu);
+		ASSERT_EQ(nullptr, alloc.Allocate(32 * 1024, 8));
+	}
+
+	TEST(ConcurrentFreeListAllocatorTest, AllocateFromThreads)
+	{
+		ConcurrentFreeListAllocator alloc(256 * 1024);
+
+		tests::RunOnThreads(4, [&alloc](unsigned t)
+		{
+			std::vector<unsigned*> mems;
+
+			for (unsigned i = 0; i < 2000; i++)
+			{
+				unsigned *mem = static_cast<unsigned*>(alloc.Allocate(sizeof(unsigned) * (1 + (i * 7 + t) % 100), 8));
+
+				if (mem)
+				{
+					*mem = t;
+					mems.push_back(mem);
+				}
+
+				if (mems.size() > 32)
+				{
+					ASSERT_EQ(t, *mems.front());
+					alloc.Deallocate(mems.front());
+					mems.erase(mems.begin());
+				}
+			}
+
+			for (unsigned *mem : mems)
+			{
+				ASSERT_EQ(t, *mem);
+				alloc.Deallocate(mem);
+			}
+		});
+
+		ASSERT_EQ(0llu, alloc.GetNumAllocations());
+		ASSERT_GE(alloc.Consolidate(), 256 * 1024 - 64llu);
+	}
+}
+
+namespace testing_thread_cache
+{
+	typedef alloc::ThreadCache<FreeListAllocator> Cache;
+
+	TEST(ThreadCacheTest, RefillsInBatches)
+	{
+		FreeListAllocator freelist(64 * 1024);
+		Cache cache(freelist, 8);
+
+		void *mem = cache.Allocate(40, 8);
+		ASSERT_EQ(4llu, freelist.GetNumAllocations());
+		ASSERT_EQ(3llu, cache.GetCachedObjects());
+
+		// Comes back from the bin, the free list isn't touched.
+		cache.Deallocate(mem);
+		ASSERT_EQ(mem, cache.Allocate(33, 8));
+		ASSERT_EQ(4llu, freelist.GetNumAllocations());
+
+		cache.Deallocate(mem, 33, 8);
+		cache.Flush();
+
+		ASSERT_EQ(0llu, freelist.GetNumAllocations());
+		ASSERT_EQ(0llu, cache.GetCachedObjects());
+	}
+
+	TEST(ThreadCacheTest, BinsAreCapped)
+	{
+		FreeListAllocator freelist(64 * 1024);
+		Cache cache(freelist, 8);
+		std::vector<void*> mems;
+
+		for (unsigned i = 0; i < 20; i++)
+		{
+			mems.push_back(cache.Allocate(64, 8));
+		}
+
+		for (void *mem : mems)
+		{
+			cache.Deallocate(mem);
+			ASSERT_LE(cache.GetCachedObjects(), 8llu);
+		}
+
+		ASSERT_EQ(freelist.GetNumAllocations(), cache.GetCachedObjects());
+
+		// Too big to cache.
+		void *big = cache.Allocate(4096, 8);
+		const size_t allocations = freelist.GetNumAllocations();
+		cache.Deallocate(big);
+		ASSERT_EQ(allocations - 1, freelist.GetNumAllocations());
+	}
+
+	TEST(ThreadCacheTest, ThreadExitReturnsBins)
+	{
+		FreeListAllocator freelist(1024 * 1024);
+		Cache cache(freelist);
+
+		tests::RunOnThreads(4, [&cache](unsigned t)
+		{
+			for (unsigned i = 0; i < 1000; i++)
+			{
+				const size_t size = 16 + (i % 5) * 40;
+				void *mem = cache.Allocate(size, 8);
+				ASSERT_TRUE(tests::WriteAndCheck(mem, t));
+				cache.Deallocate(mem, size, 8);
+			}
+
+			// Still in the thread's bins, nobody flushed them.
+			ASSERT_GT(cache.GetCachedObjects(), 0llu);
+		});
+
+		ASSERT_EQ(0llu, freelist.GetNumAllocations());
+	}
+
+	TEST(ThreadCacheTest, SizedFreeList)
+	{
+		FreeListAllocator freelist(64 * 1024, alloc::Source(), alloc::Frees::Sized);
+		{
+			Cache cache(freelist);
+
+			for (unsigned i = 0; i < 100; i++)
+			{
+				cache.Deallocate(cache.Allocate(100, 8), 100, 8);
+			}
+		}
+
+		ASSERT_EQ(0llu, freelist.GetNumAllocations());
+	}
+}
+
+#if defined(__linux__)
+// Only defined when the tests run on MallocShim.cpp, linked in or preloaded, main() leaves the tests out otherwise.
+extern "C" int memallocs_owns(void *address) __attribute__((weak));
+
+namespace testing_malloc_shim
+{
+	TEST(MallocShimTest, ServesMallocAndNew)
+	{
+		for (size_t size : { 1, 100, 1024, 1025, 100000 })
+		{
+			void *mem = malloc(size);
+			ASSERT_TRUE(memallocs_owns(mem));
+			EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, mem, 16);
+			ASSERT_GE(malloc_usable_size(mem), size);
+			free(mem);
+		}
+
+		int *object = new int(1);
+		ASSERT_TRUE(memallocs_owns(object));
+		delete object;
+	}
+
+	TEST(MallocShimTest, AlignedOperators)
+	{
+		struct alignas(128) Aligned
+		{
+			char bytes[200];
+		};
+
+		Aligned *object = new(std::nothrow) Aligned;
+		ASSERT_TRUE(memallocs_owns(object));
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, object, 128);
+		delete object;
+
+		Aligned *array = new Aligned[3];
+		EXPECT_PRED_FORMAT2(tests::AssertAdjustmentInFormat2, array, 128);
+		delete[] array;
+	}
+
+	TEST(MallocShimTest, ReallocKeepsContents)
+	{
+		unsigned char *mem = static_cast<unsigned char*>(malloc(10));
+
+		for (unsigned i = 0; i < 10; i++)
+		{
+			mem[i] = static_cast<unsigned char>(i);
+		}
+
+		// From a pool to a bigger pool, to the free list, then in the free list.
+		for (size_t size : { 100, 5000, 50000 })
+		{
+			mem = static_cast<unsigned char*>(realloc(mem, size));
+			ASSERT_TRUE(memallocs_owns(mem));
+
+			for (unsigned i = 0; i < 10; i++)
+			{
+				ASSERT_EQ(i, mem[i]);
+			}
+		}
+
+		free(mem);
+	}
+
+	TEST(MallocShimTest, ReallocOfForeignMemoryFails)
+	{
+		const size_t page_size = alloc::vm::PageSize();
+		void *page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		ASSERT_NE(MAP_FAILED, page);
+		memset(page, 7, 16);
+
+		errno = 0;
+		ASSERT_EQ(nullptr, realloc(page, 1000));
+		ASSERT_EQ(ENOMEM, errno);
+		ASSERT_EQ(7, static_cast<unsigned char*>(page)[15]);
+
+		munmap(page, page_size);
+	}
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+
+#if defined(__linux__)
+	// This gtest can't skip from inside a test, so the shim tests are filtered out, and say so.
+	if (!memallocs_owns)
+	{
+		std::string &filter = testing::GTEST_FLAG(filter);
+		filter += filter.find('-') == std::string::npos ? "-MallocShimTest.*" : ":MallocShimTest.*";
+
+		printf("Skipping MallocShimTest, MallocShim.cpp is neither linked in nor preloaded.\n");
+	}
+#endif
+
 	return RUN_ALL_TESTS();
 }
@@ -3,9 +3,12 @@
 #include "gtest/gtest.h"
 #include "Allocator.h"
 
+#include <thread>
+#include <vector>
+
 namespace tests
 {
-	inline testing::AssertionResult AssertAdjustmentInFormat2(const char *address_expr, const char *alignment_expr, void *address, uint8_t alignment)
+	inline testing::AssertionResult AssertAdjustmentInFormat2(const char *address_expr, const char *alignment_expr, void *address, size_t alignment)
 	{
 		if (alloc::IsAdjusted(address, alignment))
 		{
@@ -16,4 +19,41 @@ namespace tests
 			<< address_expr << " and " << alignment_expr
 			<< " (" << reinterpret_cast<uintptr_t>(address) << " is not aligned by " << alignment_expr << ")";
 	}
+
+	// Calls (@param body) with 0 to (@param num_threads) - 1, each on a thread of its own, all at once, and waits for them.
+	template<class F>
+	void RunOnThreads(unsigned num_threads, F body)
+	{
+		std::vector<std::thread> threads;
+
+		for (unsigned t = 0; t < num_threads; t++)
+		{
+			threads.emplace_back(body, t);
+		}
+
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	// Writes (@param t) to the memory and reads it back, another thread given the same memory would overwrite it.
+	inline testing::AssertionResult WriteAndCheck(void *address, unsigned t)
+	{
+		if (!address)
+		{
+			return testing::AssertionFailure() << "no memory for thread " << t;
+		}
+
+		volatile unsigned *mem = static_cast<unsigned*>(address);
+		*mem = t;
+		std::this_thread::yield();
+
+		if (*mem != t)
+		{
+			return testing::AssertionFailure() << "thread " << t << " found " << *mem << " in its memory";
+		}
+
+		return testing::AssertionSuccess();
+	}
 }